@@ -93,7 +93,12 @@ triangleIndexList =               <- allocated and filled by the function
           1,                      <- DirectX wants clockwise triangles
           &numTriangleVertices);  <- filled by the function
 
-The calling function is responsible for releasing the return value with free().
+The calling function is responsible for releasing the return value with free(),
+unless the ClarksonContext was made with reuseStorage (see below).
+
+Points that are already stored as doubles, for example inside an array of structures, can be
+triangulated in place with BuildTriangleIndexListStrided(ctx, &xy[0].x, stride, scale, ...):
+point i is read at xy[i*stride], xy[i*stride+1] and rounded to the integer grid floor(x*scale+0.5).
 
 That return value is an array of indices into the point list, and they define the triangles.
 
@@ -119,73 +124,109 @@ Then free the array:
 -------------------------------------------------------------------------------------- */
 
 
-static int *ptrToIntsToIndex, *listOfIntsToIndex;
-static float *ptrFloatsToIndex, *listOfFloatsToIndex, mult_up;
-
-static WORD *ptrToOutputList ;
-static int triangleDirection;
+// --------- from ch.c : numerical functions for hull computation ---------
+const int    EXACT_BITS = 53;   // = (int)floor (DBL_MANT_DIG * log ((double)FLT_RADIX) / log(2.) );
+const double B_ERR_MIN = (float)(DBL_EPSILON*MAXDIM*(1<<MAXDIM)*MAXDIM*3.01);
+const double B_ERR_MIN_SQ = B_ERR_MIN * B_ERR_MIN;
 
-static int numPointsProcessed;
-static int totalInputPoints;
-static int maxOutputEntries ;
-static int currenOutputIndex;
-static void triangleList_out (int v0, int v1, int v2, int v3);
+#define DELIFT 0
 
-static point site_blocks[MAXBLOCKS];
-static int   num_blocks;
+// All the state of the triangulator, which used to be file-level statics, lives in a ClarksonContext,
+// so that several point sets can be triangulated at the same time (one context per thread or mesh).
+// The functions below are Clarkson's, turned into members with as few changes as possible.
+//
+// With reuseStorage the simplex, basis and site blocks, the work stacks and the output index list
+// are kept at the end of a call and handed out again by the next one, so a context that is called
+// every timestep only allocates when the number of points grows. The returned list then belongs
+// to the context: it must not be freed and is only valid until the next call.
+class ClarksonContext {
+public:
+   explicit ClarksonContext(bool reuse = false) : reuseStorage(reuse) {}
+   ClarksonContext(const ClarksonContext&) = delete;             // tt_basisp points into the object
+   ClarksonContext& operator=(const ClarksonContext&) = delete;
+   ~ClarksonContext() { ReleaseMemory(); free(outputBuffer); }
+
+   WORD *BuildTriangleIndexList (void *pointList, float factor, int numberOfInputPoints, int numDimensions, int clockwise, int *numTriangleVertices);
+   WORD *BuildTriangleIndexListStrided (const double *xy, int stride, double scale, int numberOfInputPoints, int clockwise, int *numTriangleVertices);
+
+private:
+typedef simplex * (ClarksonContext::*visit_func)(simplex *, void *);
+typedef int (ClarksonContext::*test_func)(simplex *, int, void *);
+
+int *ptrToIntsToIndex = NULL, *listOfIntsToIndex = NULL;
+float *ptrFloatsToIndex = NULL, *listOfFloatsToIndex = NULL, mult_up;
+const double *ptrDoublesToIndex = NULL, *listOfDoublesToIndex = NULL;   // 2-D points read in place, doubleStride apart
+int    doubleStride;
+double double_mult_up;
+
+WORD *ptrToOutputList ;
+int triangleDirection;
+
+bool reuseStorage;
+WORD *outputBuffer = NULL;     // kept output list, reuseStorage only
+int   outputCapacity = 0;
+
+int numPointsProcessed;
+int totalInputPoints;
+int maxOutputEntries ;
+int currenOutputIndex;
+
+point site_blocks[MAXBLOCKS];
+int   num_blocks;
+int   num_site_blocks_allocated = 0;   // blocks in site_blocks that are malloc'ed, num_blocks of them in use
 
 // The next block of variables were static variables within functions that I moved
 // outside of the function.  I prepended each of the variables with the name of the function.
 // For example: sc_lscale was originally "lscale" in sc()
 //              visit_triang_gen_ss was originally "ss" in visit_triang_gen()
 //              search_ss was originally "ss" in search()
-static long get_next_site_s_num;
-static neighbor out_of_flat_p_neigh;
-static basis_s *sees_b;
-static long visit_triang_gen_vnum;
-static long visit_triang_gen_ss;
-static simplex **visit_triang_gen_st;
-static simplex **search_st;
-static long search_ss;
-static int   sc_lscale;
-static double   sc_max_scale, sc_ldetbound, sc_Sb;
-static simplex *make_facets_ns;
-
-// --------- from ch.c : numerical functions for hull computation ---------
-const int    EXACT_BITS = 53;   // = (int)floor (DBL_MANT_DIG * log ((double)FLT_RADIX) / log(2.) );
-const double B_ERR_MIN = (float)(DBL_EPSILON*MAXDIM*(1<<MAXDIM)*MAXDIM*3.01);
-const double B_ERR_MIN_SQ = B_ERR_MIN * B_ERR_MIN;
-
-static Coord  hull_infinity[10]={57.2,0,0,0,0}; /* point at infinity for Delaunay triangulation; value not used */
-
-static basis_s   tt_basis = {0,1,-1,0,0,0},
+long get_next_site_s_num;
+neighbor out_of_flat_p_neigh = {0,0,0};
+basis_s *sees_b = NULL;
+long visit_triang_gen_vnum;
+long visit_triang_gen_ss = 2000;
+simplex **visit_triang_gen_st = NULL;
+simplex **search_st = NULL;
+long search_ss = MAXDIM;
+int   sc_lscale;
+double   sc_max_scale, sc_ldetbound, sc_Sb;
+simplex *make_facets_ns;
+
+Coord  hull_infinity[10]={57.2,0,0,0,0}; /* point at infinity for Delaunay triangulation; value not used */
+
+basis_s   tt_basis = {0,1,-1,0,0,{0}},
                  *tt_basisp = &tt_basis,
                  *infinity_basis;
 
-static int   pdim;   /* point dimension */
-static simplex *ch_root;
+int   pdim;   /* point dimension */
+simplex *ch_root;
 
-#define DELIFT 0
-static int basis_vec_size;
+int basis_vec_size;
 
 // ------ from hull.c : "combinatorial" functions for hull computation
-static long pnum;
-static site p;
-static int  rdim,   /* region dimension: (max) number of sites specifying region */
+long pnum;
+site p;
+int  rdim,   /* region dimension: (max) number of sites specifying region */
             cdim,   /* number of sites currently specifying region */
-            site_size, /* size of malloc needed for a site */
+            site_size = 0, /* size of malloc needed for a site */
             point_size;  /* size of malloc needed for a point */
 
 // STORAGE(simplex)    expands into:
- size_t simplex_size;
+ size_t simplex_size = 0;
  simplex *simplex_list = 0;
+ simplex *simplex_block_table[max_blocks];
+ int num_simplex_blocks = 0;
+ int num_simplex_blocks_allocated = 0;
  simplex *new_block_simplex(int make_blocks)  {
     int i;
-    static simplex *simplex_block_table[max_blocks];
     simplex *xlm, *xbt;
-    static int num_simplex_blocks;
     if (make_blocks)  {
-      xbt = simplex_block_table[num_simplex_blocks++] = (simplex*)malloc(Nobj * simplex_size);
+      if (num_simplex_blocks < num_simplex_blocks_allocated)     // a block kept from the previous call
+         xbt = simplex_block_table[num_simplex_blocks++];
+      else {
+         xbt = simplex_block_table[num_simplex_blocks++] = (simplex*)malloc(Nobj * simplex_size);
+         num_simplex_blocks_allocated = num_simplex_blocks;
+      }
       memset(xbt, 0, Nobj *simplex_size);
       xlm = (simplex*)( (char*)xbt + (Nobj * simplex_size));
       for (i=0;i<Nobj; i++) {
@@ -196,25 +237,32 @@ static int  rdim,   /* region dimension: (max) number of sites specifying region
       }
       return simplex_list;
     }
-    for (i=0; i<num_simplex_blocks; i++)  free(simplex_block_table[i]);
+    for (i=0; i<num_simplex_blocks_allocated; i++)  free(simplex_block_table[i]);
     *simplex_block_table = 0;
-    num_simplex_blocks = 0;
+    num_simplex_blocks = num_simplex_blocks_allocated = 0;
     simplex_list = 0;
     return 0;
  }
  void free_simplex_storage(void) { new_block_simplex(0); }
+ void reset_simplex_storage(void) { num_simplex_blocks = 0; simplex_list = 0; }
 
 
 // STORAGE(basis_s)    expands into:
- size_t basis_s_size;
+ size_t basis_s_size = 0;
  basis_s *basis_s_list = 0;
+ basis_s *basis_s_block_table[max_blocks];
+ int num_basis_s_blocks = 0;
+ int num_basis_s_blocks_allocated = 0;
  basis_s *new_block_basis_s(int make_blocks) {
     int i;
-    static basis_s *basis_s_block_table[max_blocks];
     basis_s *xlm, *xbt;
-    static int num_basis_s_blocks;
  if (make_blocks) {
-    xbt = basis_s_block_table[num_basis_s_blocks++] = (basis_s*)malloc(Nobj *basis_s_size);
+    if (num_basis_s_blocks < num_basis_s_blocks_allocated)       // a block kept from the previous call
+       xbt = basis_s_block_table[num_basis_s_blocks++];
+    else {
+       xbt = basis_s_block_table[num_basis_s_blocks++] = (basis_s*)malloc(Nobj *basis_s_size);
+       num_basis_s_blocks_allocated = num_basis_s_blocks;
+    }
     memset(xbt,0,Nobj *basis_s_size);
     xlm = (basis_s*)( (char*)xbt + (Nobj * basis_s_size));
     for (i=0;i<Nobj; i++) {
@@ -225,49 +273,50 @@ static int  rdim,   /* region dimension: (max) number of sites specifying region
     }
     return basis_s_list;
  }
- for (i=0; i<num_basis_s_blocks; i++) free(basis_s_block_table[i]);
+ for (i=0; i<num_basis_s_blocks_allocated; i++) free(basis_s_block_table[i]);
  *basis_s_block_table = NULL;
- num_basis_s_blocks = 0;
+ num_basis_s_blocks = num_basis_s_blocks_allocated = 0;
  basis_s_list = 0;
  return 0;
  }
  void free_basis_s_storage(void) {
    new_block_basis_s(0);
  }
+ void reset_basis_s_storage(void) { num_basis_s_blocks = 0; basis_s_list = 0; }
 
 
 
 // --------- from ch.c : numerical functions for hull computation ---------
 
-static Coord Vec_dot(point x, point y) {
+Coord Vec_dot(point x, point y) {
    int i;
    Coord sum = 0;
    for (i=0;i<rdim;i++) sum += x[i] * y[i];
    return sum;
 }
 // ----------------------------------------------------------------
-static Coord Vec_dot_pdim(point x, point y) {
+Coord Vec_dot_pdim(point x, point y) {
    int i;
    Coord sum = 0;
    for (i=0;i<pdim;i++) sum += x[i] * y[i];
    return sum;
 }
 // ----------------------------------------------------------------
-static Coord Norm2(point x) {
+Coord Norm2(point x) {
    int i;
    Coord sum = 0;
    for (i=0;i<rdim;i++) sum += x[i] * x[i];
    return sum;
 }
 // ----------------------------------------------------------------
-static void Ax_plus_y(Coord a, point x, point y) {
+void Ax_plus_y(Coord a, point x, point y) {
    int i;
    for (i=0;i<rdim;i++) {
       *y++ += a * *x++;
    }
 }
 // ----------------------------------------------------------------
-static void Ax_plus_y_test(Coord a, point x, point y) {
+void Ax_plus_y_test(Coord a, point x, point y) {
    int i;
    for (i=0;i<rdim;i++) {
       // check_overshoot(*y + a * *x);
@@ -275,7 +324,7 @@ static void Ax_plus_y_test(Coord a, point x, point y) {
    }
 }
 // ----------------------------------------------------------------
-static void Vec_scale_test(int n, Coord a, Coord *x)
+void Vec_scale_test(int n, Coord a, Coord *x)
 {
     Coord *xx = x,
       *xend = xx + n   ;
@@ -288,7 +337,7 @@ static void Vec_scale_test(int n, Coord a, Coord *x)
 
 
 // ----------------------------------------------------------------
-static double sc(basis_s *v,simplex *s, int k, int j) {
+double sc(basis_s *v,simplex *s, int k, int j) {
 /* amount by which to scale up vector, for reduce_inner */
 
    double      labound;
@@ -336,7 +385,7 @@ static double sc(basis_s *v,simplex *s, int k, int j) {
 
 
 // ----------------------------------------------------------------
-static int reduce_inner(basis_s *v, simplex *s, int k) {
+int reduce_inner(basis_s *v, simplex *s, int k) {
     // nothing is using the return value of this function
    point   va = VA(v),
            vb = VB(v);
@@ -378,7 +427,7 @@ static int reduce_inner(basis_s *v, simplex *s, int k) {
 }
 
 // ----------------------------------------------------------------
-static int reduce(basis_s **v, point p, simplex *s, int k) {
+int reduce(basis_s **v, point p, simplex *s, int k) {
    // nothing is using the return value of this function
    point   z;
    point   tt = s->neigh[0].vert;
@@ -409,7 +458,7 @@ static int reduce(basis_s **v, point p, simplex *s, int k) {
 }
 
 // ----------------------------------------------------------------
-static void get_basis_sede(simplex *s) {
+void get_basis_sede(simplex *s) {
 
    int   k=1;
    neighbor *sn = s->neigh+1,
@@ -452,7 +501,7 @@ static void get_basis_sede(simplex *s) {
 
 
 // ----------------------------------------------------------------
-static int out_of_flat(simplex *root, point p) {
+int out_of_flat(simplex *root, point p) {
 
    if (!out_of_flat_p_neigh.basis)
       out_of_flat_p_neigh.basis = (basis_s*) malloc(basis_s_size);
@@ -480,7 +529,7 @@ static int out_of_flat(simplex *root, point p) {
 
 
 // ----------------------------------------------------------------
-static void get_normal_sede(simplex *s) {
+void get_normal_sede(simplex *s) {
 
    neighbor *rn;
    int i,j;
@@ -523,7 +572,7 @@ static void get_normal_sede(simplex *s) {
 }
 
 // ----------------------------------------------------------------
-static int sees(site p, simplex *s) {
+int sees(site p, simplex *s) {
    point   tt,zz;
    double   dd,dds;
    int i;
@@ -575,34 +624,51 @@ static int sees(site p, simplex *s) {
 
 
 // ----------------------------------------------------------------
-static void ReleaseMemory(void)  {
+void ReleaseMemory(void)  {
    int i;
 free_basis_s_storage();
 free_simplex_storage();
 
-for (i=0; i<num_blocks; i++)
+for (i=0; i<num_site_blocks_allocated; i++)
    free (site_blocks[i]);
+num_blocks = num_site_blocks_allocated = 0;
 if (sees_b)
    free (sees_b);
+if (out_of_flat_p_neigh.basis)
+   free (out_of_flat_p_neigh.basis);
 if (visit_triang_gen_st)
    free (visit_triang_gen_st);
 if (search_st)
    free (search_st);
+sees_b = NULL;
+out_of_flat_p_neigh.basis = 0;
+visit_triang_gen_st = NULL;
+visit_triang_gen_ss = 2000;
+search_st = NULL;
+search_ss = MAXDIM;
+}
+
+// ----------------------------------------------------------------
+void ResetMemory(void)  {
+// reuseStorage: put every block back in its pool for the next call, nothing is freed
+reset_basis_s_storage();
+reset_simplex_storage();
+num_blocks = 0;
 }
 
 // ----------------------------------------------------------------
-static simplex *facet_test(simplex *s, void *dummy) {return (!s->peak.vert) ? s : NULL;}
+simplex *facet_test(simplex *s, void *dummy) {return (!s->peak.vert) ? s : NULL;}
 // -------------------------------------------
-static int hullt(simplex *s, int i, void *dummy) {return i>-1;}
+int hullt(simplex *s, int i, void *dummy) {return i>-1;}
 // -------------------------------------------
-static int truet(simplex *s, int i, void *dum) {return 1;}
+int truet(simplex *s, int i, void *dum) {return 1;}
 // -------------------------------------------
-static simplex *visit_triang(simplex *root, visit_func *visit)
+simplex *visit_triang(simplex *root, visit_func visit)
    /* visit the whole triangulation */
-   {return visit_triang_gen(root, visit, truet);}
+   {return visit_triang_gen(root, visit, &ClarksonContext::truet);}
 
 // ----------------------------------------------------------------
-static void build_convex_hull(void) {
+void build_convex_hull(void) {
    // site_numm   returns number of site when given site
    // dim         dimension of point set
 
@@ -618,25 +684,25 @@ static void build_convex_hull(void) {
    numPointsProcessed = 0;
    ptrToIntsToIndex  = listOfIntsToIndex;    // reset this in case the points are integers
    ptrFloatsToIndex = listOfFloatsToIndex;   // reset this in case the points are floats
+   ptrDoublesToIndex = listOfDoublesToIndex; // reset this in case the points are doubles
 
    ptrToOutputList = NULL;
 
    get_next_site_s_num = 0;
-   memset ((char*)site_blocks, 0, sizeof (site_blocks) );
    num_blocks = 0;
 
-   out_of_flat_p_neigh.basis = 0;
+   // the blocks kept by a previous call can only be reused if the objects are still the same size
+   if (site_size != (int)(sizeof(Coord)*pdim) ||
+       basis_s_size != sizeof(basis_s)+ (2*rdim-1)*sizeof(Coord) ||
+       simplex_size != sizeof(simplex) + (rdim-1)*sizeof(neighbor))
+      ReleaseMemory();
+
+   // the work buffers (sees_b, out_of_flat_p_neigh.basis and the search stacks) are allocated on
+   // first use and set back to NULL by ReleaseMemory()
    out_of_flat_p_neigh.simp = 0;
    out_of_flat_p_neigh.vert = 0;
 
-   sees_b = NULL;
-
-   visit_triang_gen_st = NULL;
    visit_triang_gen_vnum = -1;
-   visit_triang_gen_ss = 2000;
-
-   search_st = NULL;
-   search_ss = MAXDIM;
 
    tt_basis.next = NULL;
    tt_basis.ref_count = 1;
@@ -698,15 +764,18 @@ static void build_convex_hull(void) {
    buildhull(root);  // process the points
 
    /* visit all simplices with facets of the current hull */
-   visit_triang_gen( visit_triang(root, facet_test), facets_print, hullt);      // create a triangle list
+   visit_triang_gen( visit_triang(root, &ClarksonContext::facet_test), &ClarksonContext::facets_print, &ClarksonContext::hullt);      // create a triangle list
 
-   ReleaseMemory();
+   if (reuseStorage)
+      ResetMemory();
+   else
+      ReleaseMemory();
 }
 
 
 
 // -------------------------------------------
-static simplex *visit_triang_gen(simplex *s, visit_func *visit, test_func *test) {
+simplex *visit_triang_gen(simplex *s, visit_func visit, test_func test) {
    /*
     * starting at s, visit simplices t such that test(s,i,0) is true,
     * and t is the i'th neighbor of s;
@@ -734,9 +803,9 @@ static simplex *visit_triang_gen(simplex *s, visit_func *visit, test_func *test)
       popv(t)
       if (!t || t->visit == visit_triang_gen_vnum) continue;
       t->visit = visit_triang_gen_vnum;
-      if (v=(*visit)(t,0)) {return (simplex*)v;}
+      if (v=(this->*visit)(t,0)) {return (simplex*)v;}
       for (i=-1,sn = t->neigh-1;i<cdim;i++,sn++)
-         if ((sn->simp->visit != visit_triang_gen_vnum) && sn->simp && test(t,i,0))
+         if ((sn->simp->visit != visit_triang_gen_vnum) && sn->simp && (this->*test)(t,i,0))
             pushv(sn->simp)
    }
    return NULL;
@@ -745,7 +814,7 @@ static simplex *visit_triang_gen(simplex *s, visit_func *visit, test_func *test)
 
 
 // ----------------------------------------------------------------
-static neighbor *op_simp(simplex *a, simplex *b) {{
+neighbor *op_simp(simplex *a, simplex *b) {{
       int i;
    /* the neighbor entry of a containing b */
    neighbor *x;
@@ -757,7 +826,7 @@ static neighbor *op_simp(simplex *a, simplex *b) {{
 
 
 // ----------------------------------------------------------------
-static neighbor *op_vert(simplex *a, site b)   {  {
+neighbor *op_vert(simplex *a, site b)   {  {
    int i;
    /* the neighbor entry of a containing b */
   neighbor *x;
@@ -770,7 +839,7 @@ static neighbor *op_vert(simplex *a, site b)   {  {
 
 
 // ----------------------------------------------------------------
-static void connect(simplex *s) {
+void connect(simplex *s) {
 /* make neighbor connections between newly created simplices incident to p */
 
    site xf,xb,xfi;
@@ -810,7 +879,7 @@ static void connect(simplex *s) {
 
 
 // ----------------------------------------------------------------
-static simplex *make_facets(simplex *seen) {
+simplex *make_facets(simplex *seen) {
 /*
  * visit simplices s with sees(p,s), and make a facet for every neighbor
  * of s not seen by p
@@ -866,7 +935,7 @@ static simplex *make_facets(simplex *seen) {
 
 
 // ----------------------------------------------------------------
-static simplex *extend_simplices(simplex *s) {
+simplex *extend_simplices(simplex *s) {
 /*
  * p lies outside flat containing previous sites;
  * make p a vertex of every current simplex, and create some new simplices
@@ -928,7 +997,7 @@ static simplex *extend_simplices(simplex *s) {
 
 
 // ----------------------------------------------------------------
-static simplex *search(simplex *root) {
+simplex *search(simplex *root) {
 /* return a simplex s that corresponds to a facet of the
  * current hull, and sees(p, s) */
 
@@ -961,16 +1030,19 @@ static simplex *search(simplex *root) {
 
 
 // -------------------------------------------
-static site new_site (site p, long j) {
+site new_site (site p, long j) {
 
 if (0==(j%BLOCKSIZE)) {
+   if (num_blocks < num_site_blocks_allocated)      // a block kept from the previous call
+      return(site_blocks[num_blocks++]);
+   num_site_blocks_allocated = num_blocks + 1;
    return(site_blocks[num_blocks++]=(site)malloc(BLOCKSIZE*site_size));
 } else
    return p + pdim;
 }
 
 // -------------------------------------------
-static site get_next_site(void) {
+site get_next_site(void) {
     int i;
 p = new_site(p, get_next_site_s_num);
 get_next_site_s_num++;
@@ -978,7 +1050,16 @@ get_next_site_s_num++;
 if (numPointsProcessed >= totalInputPoints)  {
    // guess at how much memory is needed for the output list
    maxOutputEntries = numPointsProcessed * 3*3; // 3 values per triangle, and there will be about 2 times as many triangles as input points
-   ptrToOutputList = (WORD*)malloc((maxOutputEntries + 1) * sizeof(WORD));
+   if (reuseStorage)  {
+      if (maxOutputEntries + 1 > outputCapacity)  {   // grow by at least half, the number of points goes up by one at a time
+         outputCapacity = (maxOutputEntries + 1 > outputCapacity + outputCapacity/2) ? maxOutputEntries + 1 : outputCapacity + outputCapacity/2;
+         free(outputBuffer);
+         outputBuffer = (WORD*)malloc(outputCapacity * sizeof(WORD));
+      }
+      ptrToOutputList = outputBuffer;
+   }
+   else
+      ptrToOutputList = (WORD*)malloc((maxOutputEntries + 1) * sizeof(WORD));
    currenOutputIndex = 0;
    return 0;
 }
@@ -987,6 +1068,12 @@ if (ptrToIntsToIndex)  {         // if there is a list of integer points
       p[i] = *ptrToIntsToIndex++;
    }
 }
+else if (ptrDoublesToIndex)  {   // a strided list of doubles, converted to integers the same way
+   for (i=0; i<pdim; i++)  {
+      p[i] = floor(ptrDoublesToIndex[i] * double_mult_up + 0.5);
+   }
+   ptrDoublesToIndex += doubleStride;
+}
 else  {                         // else convert the floating points to integers
    for (i=0; i<pdim; i++)  {
       p[i] = floor(*ptrFloatsToIndex * mult_up + 0.5);
@@ -998,7 +1085,7 @@ return p;
 }
 
 // -------------------------------------------
-static long site_numm(site p) {
+long site_numm(site p) {
    long i,j;
 
    if (p==hull_infinity) return -1;
@@ -1010,7 +1097,7 @@ static long site_numm(site p) {
 }
 
 // ----------------------------------------------------------------
-static point get_another_site(void) {
+point get_another_site(void) {
    point pnext;
 
    pnext = get_next_site();
@@ -1022,7 +1109,7 @@ static point get_another_site(void) {
 
 
 // ----------------------------------------------------------------
-static void buildhull (simplex *root) {
+void buildhull (simplex *root) {
 
    while (cdim < rdim) {
       p = get_another_site();
@@ -1038,7 +1125,7 @@ static void buildhull (simplex *root) {
 
 
 // ------------------------------------------------------
-static simplex *facets_print(simplex *s, void *p) {
+simplex *facets_print(simplex *s, void *p) {
    point v[MAXDIM];
    int j;
 
@@ -1050,20 +1137,26 @@ return NULL;
 }
 
 // ---------------------------------------------------------------------------
-static int IsFloatTriangleClockwise (float *a, float *b, float *c)  {
+int IsFloatTriangleClockwise (float *a, float *b, float *c)  {
+return ( ((b[0] - a[0]) * (b[1] + a[1]) +
+          (c[0] - b[0]) * (c[1] + b[1]) +
+          (a[0] - c[0]) * (a[1] + c[1])) > 0);
+}
+// ---------------------------------------------------------------------------
+int IsDoubleTriangleClockwise (const double *a, const double *b, const double *c)  {
 return ( ((b[0] - a[0]) * (b[1] + a[1]) +
           (c[0] - b[0]) * (c[1] + b[1]) +
           (a[0] - c[0]) * (a[1] + c[1])) > 0);
 }
 // ---------------------------------------------------------------------------
-static int IsTriangleClockwise (int *a, int *b, int *c)  {
+int IsTriangleClockwise (int *a, int *b, int *c)  {
 return ( ((b[0] - a[0]) * (b[1] + a[1]) +
           (c[0] - b[0]) * (c[1] + b[1]) +
           (a[0] - c[0]) * (a[1] + c[1])) > 0);
 }
 
 // ------------------------------------------------------
-static void triangleList_out (int v0, int v1, int v2, int v3) {
+void triangleList_out (int v0, int v1, int v2, int v3) {
     // outfunc: given a list of points, output in a given format
     // if one of the values < 0, it is a point to identify the convex hull rather than a triangle
     int isCW;
@@ -1081,6 +1174,9 @@ static void triangleList_out (int v0, int v1, int v2, int v3) {
          if (ptrToIntsToIndex)  {         // if there is a list of integer points
             isCW = IsTriangleClockwise (&listOfIntsToIndex[v0*2], &listOfIntsToIndex[v1*2], &listOfIntsToIndex[v2*2]);
          }
+         else if (ptrDoublesToIndex)  {
+            isCW = IsDoubleTriangleClockwise (&listOfDoublesToIndex[v0*doubleStride], &listOfDoublesToIndex[v1*doubleStride], &listOfDoublesToIndex[v2*doubleStride]);
+         }
          else  {
             isCW = IsFloatTriangleClockwise (&listOfFloatsToIndex[v0*2], &listOfFloatsToIndex[v1*2], &listOfFloatsToIndex[v2*2]);
          }
@@ -1104,8 +1200,10 @@ static void triangleList_out (int v0, int v1, int v2, int v3) {
    }
 }
 
+};   // class ClarksonContext
+
 // ------------------------------------------------------
-WORD *BuildTriangleIndexList (void *pointList, float factor, int numberOfInputPoints, int numDimensions, int clockwise, int *numTriangleVertices) {
+WORD *ClarksonContext::BuildTriangleIndexList (void *pointList, float factor, int numberOfInputPoints, int numDimensions, int clockwise, int *numTriangleVertices) {
    // returns an index list that can be used by: ->IASetIndexBuffer(), using the format: DXGI_FORMAT_R16_UINT
    // Adjust triangleList_out() if you do not want to spend time putting the triangles into clockwise order,
    // or to put them in anti-clockwise order.
@@ -1115,8 +1213,9 @@ WORD *BuildTriangleIndexList (void *pointList, float factor, int numberOfInputPo
    // more than 64,000 triangles at a time
 
 
+listOfDoublesToIndex = NULL;
     if (factor)  {
-   ptrToIntsToIndex = NULL;     // set to NULL to show get_next_site() to process floating-points
+   listOfIntsToIndex = NULL;    // set to NULL to show get_next_site() to process floating-points
    mult_up = factor;
    listOfFloatsToIndex = (float*)pointList;
 }
@@ -1133,7 +1232,42 @@ triangleDirection = clockwise;
 build_convex_hull();    // This function does all the work
 
 *numTriangleVertices = currenOutputIndex;
-return ptrToOutputList ;    // calling function has to free return value: ptrToOutputList ;
+return ptrToOutputList ;    // calling function has to free return value: ptrToOutputList, unless reuseStorage is set
 }
 
+// ------------------------------------------------------
+WORD *ClarksonContext::BuildTriangleIndexListStrided (const double *xy, int stride, double scale, int numberOfInputPoints, int clockwise, int *numTriangleVertices) {
+   // 2-D points read straight from the caller's array, without copying them into a float list first
+listOfIntsToIndex = NULL;
+listOfFloatsToIndex = NULL;
+listOfDoublesToIndex = xy;
+doubleStride = stride;
+double_mult_up = scale;
+
+pdim = 2;
+totalInputPoints = numberOfInputPoints;
+triangleDirection = clockwise;
 
+build_convex_hull();
+
+*numTriangleVertices = currenOutputIndex;
+return ptrToOutputList ;
+}
+
+// ------------------------------------------------------
+WORD *BuildTriangleIndexList (ClarksonContext *ctx, void *pointList, float factor, int numberOfInputPoints, int numDimensions, int clockwise, int *numTriangleVertices) {
+   // reentrant version: all the state is kept in ctx, which can be reused for the next call
+   return ctx->BuildTriangleIndexList(pointList, factor, numberOfInputPoints, numDimensions, clockwise, numTriangleVertices);
+}
+
+// ------------------------------------------------------
+WORD *BuildTriangleIndexListStrided (ClarksonContext *ctx, const double *xy, int stride, double scale, int numberOfInputPoints, int clockwise, int *numTriangleVertices) {
+   return ctx->BuildTriangleIndexListStrided(xy, stride, scale, numberOfInputPoints, clockwise, numTriangleVertices);
+}
+
+// ------------------------------------------------------
+WORD *BuildTriangleIndexList (void *pointList, float factor, int numberOfInputPoints, int numDimensions, int clockwise, int *numTriangleVertices) {
+   // original signature, uses one context per thread
+   static thread_local ClarksonContext ctx;
+   return BuildTriangleIndexList(&ctx, pointList, factor, numberOfInputPoints, numDimensions, clockwise, numTriangleVertices);
+}
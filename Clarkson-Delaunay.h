@@ -33,12 +33,6 @@ typedef struct basis_s {
    Coord vecs[1]; /* the actual vectors, extended by malloc'ing bigger */
 } basis_s;
 
-//STORAGE_GLOBALS(basis_s)
-  extern size_t basis_s_size;
-  extern basis_s *basis_s_list;
-  extern basis_s *new_block_basis_s(int);
-  extern void flush_basis_s_blocks(void);
-  void free_basis_s_storage(void);
 
 
 typedef struct neighbor {
@@ -56,12 +50,6 @@ typedef struct simplex {
    neighbor peak;      /* if null, remaining vertices give facet */
    neighbor neigh[1];   /* neighbors of simplex */
 } simplex;
-// STORAGE_GLOBALS(simplex)
-  extern size_t simplex_size;
-  extern simplex *simplex_list;
-  extern simplex *new_block_simplex(int);
-  extern void flush_simplex_blocks(void);
-  void free_simplex_storage(void);
 
 
 typedef struct fg_node fg;
@@ -98,13 +86,7 @@ typedef struct fg_node {
 
 
 
-typedef simplex * visit_func(simplex *, void *);
-typedef int test_func(simplex *, int, void *);
-
-static int sees(site, simplex *);
-static void buildhull(simplex *);
-static simplex *facets_print(simplex *s, void *p);
-static simplex *visit_triang_gen(simplex *s, visit_func *visit, test_func *test);
+// the storage pools and the functions working on them are members of ClarksonContext (Clarkson-Delaunay.cpp)
 
 
 
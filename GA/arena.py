@@ -11,6 +11,10 @@ except ImportError as e:
 # simulation executable must be in current working directory:
 simex = os.path.abspath('/home/finley/SLCU/frapc_with_triangles/GA/leafsim')
 
+# shared library to run the simulations in this process (see leafsim.py),
+# if it is set the executable is not used, nor the files below:
+simlib = ''
+
 # name of file where simulation provides its results, or 'stdout':
 simout = 'outputFourierCoeffs.csv'
 
@@ -35,8 +39,7 @@ def calculate_fitness(file_path, target):
     Calculate fitness expressing the relative contribution of the fourth Fourier coefficient.
     Higher fourth coefficient means higher fitness.
     """
-    sum_coeff_values = 0  # Initialize the sum of all coefficient magnitudes
-    fourth_coeff_value = 0  # Initialize the fourth coefficient value
+    magnitudes = {}  # coefficient magnitude of each index
 
     # Open the CSV file in read mode
     with open(file_path, 'r') as csvfile:
@@ -49,15 +52,29 @@ def calculate_fitness(file_path, target):
                 try:
                     coeff_index = int(row[0])  # Parse the first column as an integer (coefficient index)
                     coeff_value = float(row[3])  # Parse the fourth column as a float (coefficient magnitude)
-                    if coeff_index != 0:
-                        sum_coeff_values += coeff_value  # Add the coefficient value to the sum of coeff magnitudes
-                    # Check if the current row corresponds to the fourth Fourier coefficient (index 4)
-                    if coeff_index == 4:
-                        fourth_coeff_value = coeff_value  # Set the fourth coefficient value
+                    magnitudes[coeff_index] = coeff_value
 
                 except ValueError:
                     pass  # Ignore lines that cannot be parsed (e.g., headers, non-numeric data)
 
+    return fitness_from_magnitudes(magnitudes)
+
+
+def fitness_from_magnitudes(magnitudes):
+    """
+    Fitness from the magnitudes of the Fourier coefficients, a dictionary or list indexed by coefficient.
+    """
+    if isinstance(magnitudes, list):
+        magnitudes = dict(enumerate(magnitudes))
+    sum_coeff_values = 0  # Initialize the sum of all coefficient magnitudes
+    fourth_coeff_value = 0  # Initialize the fourth coefficient value
+    for coeff_index, coeff_value in magnitudes.items():
+        if coeff_index != 0:
+            sum_coeff_values += coeff_value  # Add the coefficient value to the sum of coeff magnitudes
+        # Check if the current row corresponds to the fourth Fourier coefficient (index 4)
+        if coeff_index == 4:
+            fourth_coeff_value = coeff_value  # Set the fourth coefficient value
+
     # Calculate the fitness value by dividing the fourth coefficient value by the sum of all coefficient magnitudes
     if sum_coeff_values > 0:
         fit = fourth_coeff_value / sum_coeff_values
@@ -66,3 +83,13 @@ def calculate_fitness(file_path, target):
     return fit
 
 
+def simulate_fitness(params, target):
+    """
+    Run one simulation in this process with the `simlib` library, and return its fitness
+    A simulation that fails has fitness 0, as it leaves no coefficients to read
+    """
+    import leafsim
+    coeffs = leafsim.run(params, simlib)
+    if not coeffs:
+        return 0
+    return fitness_from_magnitudes([abs(c) for c in coeffs])
@@ -13,3 +13,4 @@ RDfeedRate = [[RDfeedRate]]
 RDfeedToKillRatio= [[RDfeedToKillRatio]]
 reactRate1to2 = [[reactRate1to2]]
 lengthOfHorm2Prod = [[lengthOfHorm2Prod]]
+progressFile=progress.bin
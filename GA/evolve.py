@@ -42,6 +42,7 @@ try:
     from creature import *
     import preconfig
     import arena
+    import progress
 except ImportError as e:
     sys.stderr.write("Error loading module: %s\n"%str(e))
     sys.exit(11)
@@ -168,6 +169,8 @@ def run_simulation(bug):
     """ Run all config files found in directory 'bug.home' and return fitness """
     # Attention: in multiprocessing, any modification to argument 'bug' is lost!
     # and global variables values are not those in the parent thread!
+    if arena.simlib:
+        return run_simulation_inprocess(bug)
     cpu = cpu_sec()
     template = os.path.abspath(arena.template)
     # generate config files in bug's directory:
@@ -184,6 +187,10 @@ def run_simulation(bug):
     if verbose:
         cpu = cpu_sec() - cpu
         print(f'{bars(fit*10, 16)} CPU {cpu:6.1f} {bug.home} {bug!s}', end='')
+        # last record of the binary progress stream, if the template asks for one:
+        rec = progress.last_progress(os.path.join(bug.home, 'progress.bin'))
+        if rec:
+            print(f' steps {rec["step"]} cells {rec["cells"]}', end='')
     if old:
         fff = fit
         ggg = arena.calculate_fitness(old, bug.target)
@@ -199,6 +206,16 @@ def run_simulation(bug):
     return fit
 
 
+def run_simulation_inprocess(bug):
+    """ Run the simulation of 'bug' with the shared library, without files, and return fitness """
+    fit = arena.simulate_fitness(bug.dic, bug.target)
+    if math.isnan(fit):
+        sys.stderr.write(f'Error: invalid fitness value for {bug.home}!\n')
+    if int(os.path.basename(bug.home)) < 16:
+        print(f'{bars(fit*10, 16)} {bug.home} {bug!s} fit {fit:10.4f}')
+    return fit
+
+
 def run_simulation_trace(bug):
     """ Simulate one Creature and return its fitness"""
     # Attention: in multiprocessing, any modification to argument 'bug' is lost!
@@ -343,7 +360,7 @@ def main(args):
         sys.stderr.write("Error: elitism, crossover, mutation must add up to 1!\n")
         sys.exit(3)
     # check executable is there:
-    if not os.access(arena.simex, os.X_OK):
+    if not arena.simlib and not os.access(arena.simex, os.X_OK):
         sys.stderr.write(f'Error: could not find executable `{arena.simex}`\n')
         sys.exit(4)
     # initialize variables:
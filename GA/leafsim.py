@@ -0,0 +1,99 @@
+# Python bindings of the leafsim_core library (leafsim.h), to run simulations in-process
+# The library is found from the LEAFSIM_CORE environment variable, or next to this file
+
+try:
+    import os, sys, math, ctypes
+except ImportError as e:
+    sys.stderr.write("Error loading module: %s\n" % str(e))
+    sys.exit()
+
+RUNNING, FINISHED, FAILED = 0, 1, 2
+
+_lib = None
+
+
+def load_library(path=None):
+    """ load the shared library once, from `path` or the default locations """
+    global _lib
+    if _lib:
+        return _lib
+    if not path:
+        path = os.environ.get('LEAFSIM_CORE', '')
+    if not path:
+        path = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'libleafsim_core.so')
+    lib = ctypes.CDLL(path)
+    lib.sim_create.restype = ctypes.c_void_p
+    lib.sim_create.argtypes = [ctypes.c_char_p]
+    lib.sim_step.restype = ctypes.c_int
+    lib.sim_step.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    lib.sim_fourier.restype = ctypes.c_int
+    lib.sim_fourier.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_double), ctypes.c_int]
+    lib.sim_time.restype = ctypes.c_double
+    lib.sim_time.argtypes = [ctypes.c_void_p]
+    lib.sim_cells.restype = ctypes.c_int
+    lib.sim_cells.argtypes = [ctypes.c_void_p]
+    lib.sim_destroy.restype = None
+    lib.sim_destroy.argtypes = [ctypes.c_void_p]
+    _lib = lib
+    return lib
+
+
+def format_parameters(params):
+    """ turn a dictionary into the `name=value` text read by sim_create() """
+    return ' '.join(f'{k}={v}' for k, v in params.items())
+
+
+class Simulation(object):
+    """
+    One simulation in this process, with parameters given as a dictionary or as
+    `name=value` text. Use it in a `with` block, or call close() when done.
+    """
+
+    def __init__(self, params={}, library=None):
+        self.sim = None
+        self.lib = load_library(library)
+        if isinstance(params, dict):
+            params = format_parameters(params)
+        self.sim = self.lib.sim_create(params.encode())
+        if not self.sim:
+            raise ValueError(f'invalid simulation parameters: {params}')
+        self.status = RUNNING
+
+    def step(self, n=0):
+        """ advance by `n` steps, or to the end if `n` is 0, and return the status """
+        self.status = self.lib.sim_step(self.sim, n)
+        return self.status
+
+    def fourier(self, max_coeffs=64):
+        """ return the Fourier coefficients of the current shape as complex numbers """
+        buf = (ctypes.c_double * (2*max_coeffs))()
+        cnt = self.lib.sim_fourier(self.sim, buf, max_coeffs)
+        return [complex(buf[2*i], buf[2*i+1]) for i in range(cnt)]
+
+    def time(self):
+        return self.lib.sim_time(self.sim)
+
+    def cells(self):
+        return self.lib.sim_cells(self.sim)
+
+    def close(self):
+        if self.sim:
+            self.lib.sim_destroy(self.sim)
+            self.sim = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *args):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+
+def run(params={}, library=None):
+    """ run a simulation to the end, and return its Fourier coefficients, or None if it failed """
+    with Simulation(params, library) as sim:
+        if sim.step() != FINISHED:
+            return None
+        return sim.fourier()
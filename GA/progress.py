@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+# Reader of the binary progress stream written by the simulation (progressFile=, see log.h)
+
+"""
+    Print the progress records written by the simulation with progressFile=FILE
+
+Syntax:
+
+    progress.py FILE [follow]
+
+    With `follow', new records are printed as the simulation writes them, until interrupted.
+"""
+
+try:
+    import os, sys, time, struct
+except ImportError as e:
+    sys.stderr.write("Error loading module: %s\n" % str(e))
+    sys.exit()
+
+MAGIC = b'LSPROG01'
+RECORD = struct.Struct('<qdddii')   # step, time, timestep, wall time, cells, replica
+FIELDS = ('step', 'time', 'timestep', 'wall', 'cells', 'replica')
+
+
+def parse(data):
+    """ return the complete records in `data`, which follows the header, and the number of bytes used """
+    records = []
+    used = len(data) - len(data) % RECORD.size
+    for values in RECORD.iter_unpack(data[:used]):
+        records.append(dict(zip(FIELDS, values)))
+    return records, used
+
+
+def read_progress(path):
+    """ return all the records of the file as dictionaries, or [] if there is no valid file """
+    try:
+        with open(path, 'rb') as f:
+            data = f.read()
+    except OSError:
+        return []
+    if data[:len(MAGIC)] != MAGIC:
+        return []
+    return parse(data[len(MAGIC):])[0]
+
+
+def last_progress(path):
+    """ return the last record of the file, or None """
+    try:
+        size = os.path.getsize(path)
+    except OSError:
+        return None
+    count = (size - len(MAGIC)) // RECORD.size
+    if count < 1:
+        return None
+    with open(path, 'rb') as f:
+        if f.read(len(MAGIC)) != MAGIC:
+            return None
+        f.seek(len(MAGIC) + (count-1) * RECORD.size)
+        return dict(zip(FIELDS, RECORD.unpack(f.read(RECORD.size))))
+
+
+def follow(path, interval=0.5):
+    """ yield the records of the file as they are written, until interrupted """
+    while not os.path.exists(path) or os.path.getsize(path) < len(MAGIC):
+        time.sleep(interval)
+    with open(path, 'rb') as f:
+        if f.read(len(MAGIC)) != MAGIC:
+            raise ValueError(f'`{path}` is not a progress file')
+        data = b''
+        while True:
+            chunk = f.read()
+            if chunk:
+                data += chunk
+                records, used = parse(data)
+                data = data[used:]
+                for rec in records:
+                    yield rec
+            else:
+                time.sleep(interval)
+
+
+def format_record(rec):
+    return (f"replica {rec['replica']:4} step {rec['step']:8} time {rec['time']:10.6f}"
+            f" dt {rec['timestep']:.3e} cells {rec['cells']:6} wall {rec['wall']:8.2f} s")
+
+
+def main(args):
+    if not args:
+        print(__doc__)
+        return
+    path = args[0]
+    try:
+        if 'follow' in args[1:]:
+            for rec in follow(path):
+                print(format_record(rec), flush=True)
+        else:
+            for rec in read_progress(path):
+                print(format_record(rec))
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
@@ -0,0 +1,180 @@
+/*
+ * Batch runner: many replicas of the simulation, each with its own parameters, in one process
+ * usage: leafsim_batch base.cym replicas.txt [jobs=N] [output=batch.csv]
+ * Each line of replicas.txt is one replica, given as name=value pairs (as in a .cym file, separated by spaces)
+ * read after base.cym, for example "seed=3 RDfeedRate=0.04". The Fourier coefficients of every replica
+ * are written to one CSV file.
+ */
+
+#define REPLICA_LOCAL thread_local   /// every thread has its own simulation state, see replica.h
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#define DEBUG false
+#define HEADLESS true   /// no window, so no GLFW or OpenGL
+#define MOVING_POINTS true
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <thread>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "random.h"
+#include "vector.h"
+#include "param.h"
+#include "trace.h"
+#include "transport.h"
+#include "object.h"
+#include "polish.h"
+#include "arrays.h"
+#include "neighbours.h"
+#include "grid.h"
+#include "hormone.h"
+#include "Clarkson-Delaunay.cpp"
+#include "mesh.h"
+#include "springs.h"
+#include "simd.h"
+#include "fitness.h"
+#include "scheduler.h"
+#include "reorder.h"
+#include "domain.h"
+#include "simulation.h"
+
+
+/// what is kept of a replica once it has run
+struct ReplicaResult
+{
+    std::string parameters;
+    StepResult status = STEP_RUNNING;
+    int cells = 0;
+    std::vector<double> real, imaginary;   /// Fourier coefficients of the final shape
+};
+
+/// runs one replica to finalTime, on a thread of its own so that it starts from freshly initialised state
+void runReplica(const char* basePath, int index, ReplicaResult& result){
+    verbose = false;
+    replicaId = index;
+    readFile(basePath);
+    std::istringstream iss(result.parameters);
+    std::string token;
+    while (iss >> token) {
+        if (!readOption(token.c_str())) {
+            logMessage(LOG_WARNING, "Replica %d: unknown parameter `%s'\n", index, token.c_str());
+        }
+    }
+#ifdef _OPENMP
+    omp_set_num_threads(1);   /// the replicas are the parallelism, and the OpenMP threads would not see this thread's state
+#endif
+    initSimulation();
+
+    StepResult status;
+    do {
+        status = simulationStep();
+    } while (status == STEP_RUNNING);
+
+    result.status = status;
+    result.cells = nbo;
+    if (status == STEP_FINISHED) {
+        int fourierCoeffsNum = numFourierCoeffs();
+        double **fourierCoeffs = computeDeltaFourierCoeffs(fourierCoeffsNum);
+        for (int i = 0; i < fourierCoeffsNum; i++){
+            result.real.push_back(fourierCoeffs[i][0]);
+            result.imaginary.push_back(fourierCoeffs[i][1]);
+            free(fourierCoeffs[i]);
+        }
+        free(fourierCoeffs);
+    }
+
+    logMessage(LOG_INFO, "Replica %d %s with %d cells\n", index, (status == STEP_FINISHED) ? "finished" : "failed", nbo);
+}
+
+/// one row per Fourier coefficient of each replica, and one row for a replica that failed
+void outputBatchToFile(const std::vector<ReplicaResult>& results, const char* filename){
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        printf("Error opening file `%s'!\n", filename);
+        exit(1);
+    }
+
+    fprintf(file, "Replica,Status,Cells,Index,Real,Imaginary,Magnitude,Phase,Parameters\n");
+    for (size_t r = 0; r < results.size(); r++) {
+        const ReplicaResult& result = results[r];
+        if (result.status != STEP_FINISHED) {
+            fprintf(file, "%zu,failed,%d,,,,,,\"%s\"\n", r, result.cells, result.parameters.c_str());
+            continue;
+        }
+        for (size_t m = 0; m < result.real.size(); m++) {
+            double realValue = result.real[m];
+            double imgValue = result.imaginary[m];
+            double magnitude = sqrt(realValue * realValue + imgValue * imgValue);
+            double phase = atan2(imgValue, realValue);
+            fprintf(file, "%zu,finished,%d,%zu,%f,%f,%f,%f,\"%s\"\n", r, result.cells, m,
+                    realValue, imgValue, magnitude, phase, result.parameters.c_str());
+        }
+    }
+
+    fclose(file);
+}
+
+
+/* program entry */
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        printf("usage: %s base.cym replicas.txt [jobs=N] [output=batch.csv]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char* basePath = argv[1];
+    int jobs = std::max(1u, std::thread::hardware_concurrency());
+    std::string output = "batchFourierCoeffs.csv";
+    for (int i = 3; i < argc; ++i) {
+        if ( readParameter(argv[i], "jobs=", jobs) ) continue;
+        if ( readParameter(argv[i], "output=", output) ) continue;
+        printf("unknown argument `%s'\n", argv[i]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<ReplicaResult> results;
+    std::ifstream is(argv[2]);
+    if ( !is.good() ) {
+        printf("File `%s' cannot be read\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    std::string line;
+    while (getline(is, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos || line[0] == '%') {
+            continue;   /// blank lines and comments
+        }
+        results.push_back(ReplicaResult());
+        results.back().parameters = line;
+    }
+    jobs = std::max(1, std::min(jobs, (int)results.size()));
+    printf("Running %zu replicas, %d at a time\n", results.size(), jobs);
+
+    /// each worker takes the next replica and runs it on a new thread, which then exits with its state
+    std::atomic<int> nextReplica(0);
+    std::vector<std::thread> workers;
+    for (int w = 0; w < jobs; w++) {
+        workers.push_back(std::thread([&](){
+            int r;
+            while ((r = nextReplica++) < (int)results.size()) {
+                std::thread replica(runReplica, basePath, r, std::ref(results[r]));
+                replica.join();
+            }
+        }));
+    }
+    for (size_t w = 0; w < workers.size(); w++) {
+        workers[w].join();
+    }
+
+    logFlush();
+    outputBatchToFile(results, output.c_str());
+    printf("Fourier Coefficients Saved to %s!\n", output.c_str());
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,322 @@
+/*
+ * Benchmark of the parts of a simulation step, for following the performance from one version to the next
+ * usage: leafsim_bench [file.cym] [cells=1000,10000,100000] [layouts=random,lattice,circle]
+ *                      [warmup=3] [repeats=10] [budget=30] [json=bench.json] [csv=bench.csv] [threads=N] [name=value...]
+ *        leafsim_bench selftest=1
+ *            only checks the random streams against the known answers of Philox4x32-10 (see random.h)
+ * For every layout and number of cells, the simulation is started afresh and the cells are placed, the mesh is
+ * rebuilt from scratch a few times, then simulationStep() runs warmup steps and repeats timed steps. Each part
+ * of a step is timed on its own (see StepPart), with the solver and substeps of the parameters.
+ * A configuration stops repeating once it has used budget seconds (keeping at least one sample of each part),
+ * and the larger numbers of cells of its layout are then skipped: the lattice and the circle are degenerate
+ * for the triangulation, which gets much slower than for random positions.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#define DEBUG false
+#define HEADLESS true   /// no window, so no GLFW or OpenGL
+#define MOVING_POINTS true
+
+#include <vector>
+#include <string>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "random.h"
+#include "vector.h"
+#include "param.h"
+#include "trace.h"
+#include "transport.h"
+#include "object.h"
+#include "polish.h"
+#include "arrays.h"
+#include "neighbours.h"
+#include "grid.h"
+#include "hormone.h"
+#include "Clarkson-Delaunay.cpp"
+#include "mesh.h"
+#include "springs.h"
+#include "simd.h"
+#include "fitness.h"
+#include "scheduler.h"
+#include "reorder.h"
+#include "domain.h"
+#include "simulation.h"
+#include "layout.h"
+
+#ifndef LEAFSIM_VERSION
+#define LEAFSIM_VERSION "unknown"
+#endif
+
+/// the parts of a step that are timed: the rebuild, then the parts of simulationStep() (StepPart), then the step
+enum BenchPhase
+{
+    PHASE_REBUILD = 0,      /// triangulation from scratch (Clarkson), outside the steps
+    PHASE_MITOSIS,
+    PHASE_CONTACTS,
+    PHASE_NEIGHBOURS,
+    PHASE_SPRINGS,
+    PHASE_CHEMISTRY,
+    PHASE_STEP,             /// the whole step
+    NUM_PHASES
+};
+static_assert(PHASE_MITOSIS + NUM_STEP_PARTS == PHASE_STEP, "one phase per part of a step");
+
+const char* phaseName(int phase){
+    switch (phase) {
+        case PHASE_REBUILD:    return "rebuild";
+        case PHASE_MITOSIS:    return "mitosis";
+        case PHASE_CONTACTS:   return useContactGrid ? "grid" : "triangulation";
+        case PHASE_NEIGHBOURS: return "neighbours";
+        case PHASE_SPRINGS:    return "springs";
+        case PHASE_CHEMISTRY:  return "chemistry";
+        case PHASE_STEP:       return "step";
+    }
+    return "?";
+}
+
+/// timings of one layout and number of cells
+struct BenchResult
+{
+    std::string layout;
+    int cells;          /// at the start of the timed steps
+    int edges;          /// springs in the last timed step
+    bool truncated;     /// stopped by the time budget before all the repeats
+    std::vector<double> samples[NUM_PHASES];   /// seconds
+};
+
+/// statistics of the samples of one phase
+struct BenchStats
+{
+    double min = 0, median = 0, mean = 0, max = 0;
+
+    explicit BenchStats(std::vector<double> samples){
+        if (samples.empty()) return;
+        std::sort(samples.begin(), samples.end());
+        min = samples.front();
+        max = samples.back();
+        median = samples[samples.size()/2];
+        for (size_t i = 0; i < samples.size(); i++) {
+            mean += samples[i];
+        }
+        mean /= samples.size();
+    }
+};
+
+bool knownLayout(const std::string& layout){
+    return layout == "random" || layout == "lattice" || layout == "circle";
+}
+
+/// start a new simulation of numCells cells in the given layout, as if none had run before
+void placeCells(const std::string& layout, int numCells){
+    nbo = numCells;
+    initSimulation();
+    double radius = pointsArray.cellRadius[0];
+    if (layout == "random") {
+        initRandomSquare(2 * radius * sqrt(nbo));
+    }
+    else if (layout == "lattice") {
+        nbo = (int)floor(sqrt(numCells)) * (int)floor(sqrt(numCells));   /// the lattice is square
+        initRegularTriangularLattice();
+    }
+    else if (layout == "circle") {
+        initPerfectCircle(nbo * radius / M_PI);
+    }
+}
+
+BenchResult* lapResult = NULL;   /// where the parts of the step being timed go
+double lapLast = 0;
+
+void lapStepPart(StepPart part){
+    double now = wallTime();
+    lapResult->samples[PHASE_MITOSIS + part].push_back(now - lapLast);
+    lapLast = now;
+}
+
+/// one simulationStep(), with each of its parts timed
+void timedStep(BenchResult& result){
+    lapResult = &result;
+    stepPartDone = lapStepPart;
+    double start = wallTime();
+    lapLast = start;
+    simulationStep();
+    result.samples[PHASE_STEP].push_back(wallTime() - start);
+    stepPartDone = NULL;
+}
+
+BenchResult runBench(const std::string& layout, int numCells, int warmup, int repeats, double budget){
+    BenchResult result;
+    result.layout = layout;
+    result.truncated = false;
+    double deadline = wallTime() + budget;
+    auto keepGoing = [&](int r){
+        if (r > 0 && wallTime() > deadline) {
+            result.truncated = true;
+            return false;
+        }
+        return true;
+    };
+    DesiredTotalCells = 2 * numCells;   /// so that some cells divide at every step
+    placeCells(layout, numCells);
+
+    for (int r = 0; r < repeats && keepGoing(r); r++) {
+        leafMesh.invalidate();
+        double start = wallTime();
+        create_triangles_list();
+        result.samples[PHASE_REBUILD].push_back(wallTime() - start);
+    }
+
+    BenchResult discard;
+    for (int w = 0; w < warmup && wallTime() < deadline; w++) {
+        timedStep(discard);
+    }
+    result.cells = nbo;
+    for (int r = 0; r < repeats && keepGoing(r); r++) {
+        timedStep(result);
+    }
+    result.edges = edgeList.size();
+    return result;
+}
+
+/// splits "a,b,c"
+std::vector<std::string> splitList(const std::string& list){
+    std::vector<std::string> items;
+    std::istringstream iss(list);
+    std::string item;
+    while (getline(iss, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+void outputBenchJSON(const std::vector<BenchResult>& results, int warmup, int repeats, const char* filename){
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        printf("Error opening file `%s'!\n", filename);
+        exit(1);
+    }
+    fprintf(file, "{\n  \"version\": \"%s\",\n  \"compiler\": \"%s\",\n", LEAFSIM_VERSION, __VERSION__);
+    fprintf(file, "  \"threads\": %d,\n  \"warmup\": %d,\n  \"repeats\": %d,\n", threads, warmup, repeats);
+    fprintf(file, "  \"unit\": \"seconds\",\n  \"results\": [\n");
+    for (size_t r = 0; r < results.size(); r++) {
+        const BenchResult& result = results[r];
+        fprintf(file, "    {\"layout\": \"%s\", \"cells\": %d, \"edges\": %d, \"phases\": {\n",
+                result.layout.c_str(), result.cells, result.edges);
+        for (int p = 0; p < NUM_PHASES; p++) {
+            BenchStats stats(result.samples[p]);
+            fprintf(file, "      \"%s\": {\"samples\": %zu, \"min\": %.9f, \"median\": %.9f, \"mean\": %.9f, \"max\": %.9f}%s\n",
+                    phaseName(p), result.samples[p].size(), stats.min, stats.median, stats.mean, stats.max,
+                    (p + 1 < NUM_PHASES) ? "," : "");
+        }
+        fprintf(file, "    }}%s\n", (r + 1 < results.size()) ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+}
+
+void outputBenchCSV(const std::vector<BenchResult>& results, const char* filename){
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        printf("Error opening file `%s'!\n", filename);
+        exit(1);
+    }
+    fprintf(file, "Version,Threads,Layout,Cells,Edges,Phase,Samples,Min,Median,Mean,Max\n");
+    for (size_t r = 0; r < results.size(); r++) {
+        const BenchResult& result = results[r];
+        for (int p = 0; p < NUM_PHASES; p++) {
+            BenchStats stats(result.samples[p]);
+            fprintf(file, "%s,%d,%s,%d,%d,%s,%zu,%.9f,%.9f,%.9f,%.9f\n", LEAFSIM_VERSION, threads,
+                    result.layout.c_str(), result.cells, result.edges, phaseName(p), result.samples[p].size(),
+                    stats.min, stats.median, stats.mean, stats.max);
+        }
+    }
+    fclose(file);
+}
+
+
+/* program entry */
+int main(int argc, char *argv[]) {
+    std::string cellList = "1000,10000,100000";
+    std::string layoutList = "random,lattice,circle";
+    std::string json = "bench.json", csv = "bench.csv";
+    int warmup = 3, repeats = 10;
+    double budget = 30;   /// seconds per layout and number of cells
+    int selftest = 0;
+
+    verbose = false;
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        size_t n = strlen(arg);
+        if (n > 4 && strcmp(arg + n - 4, ".cym") == 0) {
+            readFile(arg);
+            continue;
+        }
+        if ( readParameter(arg, "cells=", cellList) ) continue;
+        if ( readParameter(arg, "layouts=", layoutList) ) continue;
+        if ( readParameter(arg, "warmup=", warmup) ) continue;
+        if ( readParameter(arg, "repeats=", repeats) ) continue;
+        if ( readParameter(arg, "budget=", budget) ) continue;
+        if ( readParameter(arg, "json=", json) ) continue;
+        if ( readParameter(arg, "csv=", csv) ) continue;
+        if ( readParameter(arg, "selftest=", selftest) ) continue;
+        if ( readOption(arg) ) continue;
+        printf("Unknown argument `%s'\n", arg);
+        return EXIT_FAILURE;
+    }
+    if (selftest) {
+        bool ok = philoxSelfCheck();
+        printf("Philox4x32-10 known answers: %s\n", ok ? "passed" : "FAILED");
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+#ifdef _OPENMP
+    omp_set_num_threads(threads);
+#endif
+    mySeed(seed);
+
+    std::vector<std::string> layouts = splitList(layoutList);
+    std::vector<std::string> cells = splitList(cellList);
+    for (size_t l = 0; l < layouts.size(); l++) {
+        if (!knownLayout(layouts[l])) {
+            printf("Unknown layout `%s'\n", layouts[l].c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<BenchResult> results;
+    for (size_t l = 0; l < layouts.size(); l++) {
+        int overBudget = 0;   /// smallest number of cells that went over the budget with this layout
+        for (size_t c = 0; c < cells.size(); c++) {
+            int numCells = atoi(cells[c].c_str());
+            if (numCells < 3 || numCells + numCells / 8 > (int)MAX) {
+                printf("Skipping %d cells, the store holds %zu with room for the divisions\n", numCells, MAX);
+                continue;
+            }
+            if (overBudget && numCells > overBudget) {
+                printf("Skipping %s with %d cells, %d cells went over the budget\n", layouts[l].c_str(), numCells, overBudget);
+                continue;
+            }
+            results.push_back(runBench(layouts[l], numCells, warmup, repeats, budget));
+            const BenchResult& result = results.back();
+            logFlush();   /// the messages of the run first
+            printf("%-8s %7d cells:", result.layout.c_str(), result.cells);
+            for (int p = 0; p < NUM_PHASES; p++) {
+                printf(" %s %.3f ms", phaseName(p), 1000 * BenchStats(result.samples[p]).median);
+            }
+            printf("%s\n", result.truncated ? " (over budget)" : "");
+            fflush(stdout);
+            if (result.truncated && (!overBudget || numCells < overBudget)) {
+                overBudget = numCells;
+            }
+        }
+    }
+
+    outputBenchJSON(results, warmup, repeats, json.c_str());
+    outputBenchCSV(results, csv.c_str());
+    printf("Timings saved to %s and %s\n", json.c_str(), csv.c_str());
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,377 @@
+//
+// Checkpoints of the whole simulation state, to continue a run that was interrupted (--restart)
+//
+
+#ifndef FRAP_CHECKPOINT_H
+#define FRAP_CHECKPOINT_H
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <type_traits>
+
+/// Every checkpointPeriod seconds the state is copied (on the simulation thread, a few copies of arrays)
+/// and a second thread writes the copy to checkpointFile, through a temporary file renamed at the end
+/// so that a run killed while writing leaves the previous checkpoint intact.
+/// The file is meant to be mapped in memory as it is, in the byte order of the machine:
+///   CheckpointHeader, then numSections CheckpointSection, then the data of each section starting at
+///   its offset, a multiple of CHECKPOINT_ALIGN.
+/// The sections are the parameters (every option read, each ending with 0), the scalars (time, step,
+/// random generator, hormone flags...), the arrays of the first nbo cells, the corrections of the
+/// IMEX solver, the triangle mesh and the division scheduler, so that a restarted run steps exactly
+/// as the original would.
+/// The version changes whenever a section changes; older files are refused.
+
+const uint32_t CHECKPOINT_VERSION = 3;   /// 2: division scheduler, 3: cell ids
+const uint64_t CHECKPOINT_ALIGN = 64;
+
+struct CheckpointHeader
+{
+    char magic[8];          /// "LSCHKPT"
+    uint32_t version;       /// CHECKPOINT_VERSION
+    uint32_t numSections;
+    uint64_t fileSize;
+    uint64_t maxCells;      /// MAX of the programme that wrote it
+};
+
+struct CheckpointSection
+{
+    char name[24];
+    uint32_t elemSize;      /// bytes per element
+    uint32_t reserved;
+    uint64_t count;         /// number of elements
+    uint64_t offset;        /// from the start of the file
+};
+
+/// everything that is not an array
+struct CheckpointScalars
+{
+    double currentTime, timestep, hormoneLimit, realTime;
+    int64_t stepCount;
+    int32_t nbo, meshNumVerts, hazardKey, nextId;
+    uint8_t hormone1Started, hormone2Started, meshValid, padding[5];
+    LegacyRandom random;
+};
+
+static_assert(std::is_trivially_copyable<CheckpointScalars>::value, "the scalars are written as they are");
+static_assert(sizeof(vector2D) == 2 * sizeof(double), "positions are written as pairs of doubles");
+
+
+/// a copy of the state, written by a thread of its own
+class CheckpointWriter
+{
+public:
+    ~CheckpointWriter(){
+        wait();
+    }
+
+    /// copy the state and start writing it to path
+    void save(const std::string& path){
+        wait();   /// the previous checkpoint is usually written long ago
+        sections.clear();
+
+        std::string options;
+        for (size_t i = 0; i < optionsRead.size(); i++) {
+            options.append(optionsRead[i]);
+            options.push_back(0);
+        }
+        add("parameters", options.data(), options.size());
+
+        CheckpointScalars scalars;
+        memset((void*)&scalars, 0, sizeof(scalars));   /// trivially copyable, and the padding in the file is always 0
+        scalars.currentTime = currentTime;
+        scalars.timestep = timestep;
+        scalars.hormoneLimit = hormoneLimit;
+        scalars.realTime = realTime;
+        scalars.stepCount = stepCount;
+        scalars.nbo = nbo;
+        scalars.meshNumVerts = leafMesh.numVerts;
+        scalars.hazardKey = divisionScheduler.hazardKey;
+        scalars.nextId = pointsArray.nextId;
+        scalars.hormone1Started = hormone1Started;
+        scalars.hormone2Started = hormone2Started;
+        scalars.meshValid = leafMesh.valid;
+        scalars.random = legacyRandom;
+        add("scalars", &scalars, 1);
+
+        add("disVec", pointsArray.disVec.data(), nbo);
+        add("springVec", pointsArray.springVec.data(), nbo);
+        add("cellRadiusBase", pointsArray.cellRadiusBase.data(), nbo);
+        add("cellRadius", pointsArray.cellRadius.data(), nbo);
+        add("myTotalHormone1", pointsArray.myTotalHormone1.data(), nbo);
+        add("myDeltaHormone1", pointsArray.myDeltaHormone1.data(), nbo);
+        add("myTotalHormone2", pointsArray.myTotalHormone2.data(), nbo);
+        add("myDeltaHormone2", pointsArray.myDeltaHormone2.data(), nbo);
+        add("isHormone1Producer", pointsArray.isHormone1Producer.data(), nbo);
+        add("isHormone2Producer", pointsArray.isHormone2Producer.data(), nbo);
+        add("cellId", pointsArray.cellId.data(), nbo);
+
+        add("correction1", hormoneIMEX.correction1.data(), hormoneIMEX.correction1.size());
+        add("correction2", hormoneIMEX.correction2.data(), hormoneIMEX.correction2.size());
+
+        add("triVerts", leafMesh.triVerts.data(), leafMesh.triVerts.size());
+        add("triNeigh", leafMesh.triNeigh.data(), leafMesh.triNeigh.size());
+        add("vertTri", leafMesh.vertTri.data(), leafMesh.vertTri.size());
+        add("meshPos", leafMesh.meshPos.data(), leafMesh.meshPos.size());
+
+        add("divisionTarget", divisionScheduler.target.data(), divisionScheduler.target.size());
+        add("divisionIntegrated", divisionScheduler.integrated.data(), divisionScheduler.integrated.size());
+        add("divisionHazard", divisionScheduler.hazard.data(), divisionScheduler.hazard.size());
+        add("divisionUpdated", divisionScheduler.updated.data(), divisionScheduler.updated.size());
+
+        int64_t step = stepCount;
+        writer = std::thread(&CheckpointWriter::write, this, path, step);
+    }
+
+    /// until the last checkpoint is written
+    void wait(){
+        if (writer.joinable()) {
+            writer.join();
+        }
+    }
+
+private:
+    struct Section
+    {
+        std::string name;
+        uint32_t elemSize;
+        uint64_t count;
+        std::vector<char> bytes;
+    };
+
+    std::vector<Section> sections;
+    std::thread writer;
+
+    template <typename T>
+    void add(const char* name, const T* data, size_t count){
+        Section section;
+        section.name = name;
+        section.elemSize = sizeof(T);
+        section.count = count;
+        section.bytes.assign((const char*)data, (const char*)data + count * sizeof(T));
+        sections.push_back(std::move(section));
+    }
+
+    static uint64_t aligned(uint64_t offset){
+        return (offset + CHECKPOINT_ALIGN - 1) / CHECKPOINT_ALIGN * CHECKPOINT_ALIGN;
+    }
+
+    void write(std::string path, int64_t step){
+        std::vector<CheckpointSection> table(sections.size());
+        uint64_t offset = aligned(sizeof(CheckpointHeader) + table.size() * sizeof(CheckpointSection));
+        for (size_t s = 0; s < sections.size(); s++) {
+            memset(&table[s], 0, sizeof(CheckpointSection));
+            strncpy(table[s].name, sections[s].name.c_str(), sizeof(table[s].name) - 1);
+            table[s].elemSize = sections[s].elemSize;
+            table[s].count = sections[s].count;
+            table[s].offset = offset;
+            offset = aligned(offset + sections[s].bytes.size());
+        }
+        CheckpointHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "LSCHKPT", 7);
+        header.version = CHECKPOINT_VERSION;
+        header.numSections = table.size();
+        header.fileSize = offset;
+        header.maxCells = MAX;
+
+        std::string temporary = path + ".tmp";
+        FILE *file = fopen(temporary.c_str(), "wb");
+        if (file == NULL) {
+            logMessage(LOG_ERROR, "Error opening file `%s'!\n", temporary.c_str());
+            return;
+        }
+        bool ok = (fwrite(&header, sizeof(header), 1, file) == 1);
+        ok &= (fwrite(table.data(), sizeof(CheckpointSection), table.size(), file) == table.size());
+        for (size_t s = 0; ok && s < sections.size(); s++) {
+            ok = (fseek(file, table[s].offset, SEEK_SET) == 0);
+            ok &= (fwrite(sections[s].bytes.data(), 1, sections[s].bytes.size(), file) == sections[s].bytes.size());
+        }
+        if (ok && (uint64_t)ftell(file) < header.fileSize) {
+            ok = (fseek(file, header.fileSize - 1, SEEK_SET) == 0) && (fputc(0, file) == 0);
+        }
+        ok &= (fclose(file) == 0);
+        if (!ok || rename(temporary.c_str(), path.c_str()) != 0) {
+            logMessage(LOG_ERROR, "Checkpoint `%s' could not be written\n", path.c_str());
+            return;
+        }
+        logMessage(LOG_INFO, "Checkpoint of step %lld saved to %s\n", (long long)step, path.c_str());
+    }
+};
+
+REPLICA_LOCAL CheckpointWriter checkpointWriter;
+REPLICA_LOCAL double lastCheckpoint = -1;   /// wall time of the last checkpoint
+
+
+/// a checkpoint file read in memory
+class CheckpointReader
+{
+public:
+    /// read and check the file, false with a message if it cannot be used
+    bool open(const char* path){
+        FILE *file = fopen(path, "rb");
+        if (file == NULL) {
+            logMessage(LOG_ERROR, "Error opening file `%s'!\n", path);
+            return false;
+        }
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        data.resize(size > 0 ? size : 0);
+        bool ok = (size > 0) && (fread(data.data(), 1, size, file) == (size_t)size);
+        fclose(file);
+
+        CheckpointHeader header;
+        if (!ok || data.size() < sizeof(header)) {
+            return error(path, "too short");
+        }
+        memcpy(&header, data.data(), sizeof(header));
+        if (memcmp(header.magic, "LSCHKPT", 8) != 0) {
+            return error(path, "not a checkpoint");
+        }
+        if (header.version != CHECKPOINT_VERSION) {
+            return error(path, "written by another version");
+        }
+        if (header.fileSize != data.size()
+            || sizeof(header) + header.numSections * sizeof(CheckpointSection) > data.size()) {
+            return error(path, "truncated");
+        }
+        table.resize(header.numSections);
+        memcpy(table.data(), data.data() + sizeof(header), table.size() * sizeof(CheckpointSection));
+        for (size_t s = 0; s < table.size(); s++) {
+            if (table[s].offset + table[s].elemSize * table[s].count > data.size()) {
+                return error(path, "truncated");
+            }
+        }
+        return true;
+    }
+
+    /// the options that were read by the run, to read them again before the state is restored
+    std::vector<std::string> options() const{
+        std::vector<std::string> list;
+        const CheckpointSection* section = find("parameters", 1);
+        if (section) {
+            const char* text = data.data() + section->offset;
+            for (uint64_t i = 0; i < section->count; i += strlen(text + i) + 1) {
+                list.push_back(text + i);
+            }
+        }
+        return list;
+    }
+
+    /// set the state of the simulation from the checkpoint
+    bool restore(){
+        CheckpointScalars scalars;
+        if (!read("scalars", &scalars, 1)) return false;
+        if (scalars.nbo < 0 || scalars.nbo >= (int)MAX) {
+            logMessage(LOG_ERROR, "Checkpoint of %d cells, this programme can only hold %zu\n", scalars.nbo, MAX);
+            return false;
+        }
+        nbo = scalars.nbo;
+        bool ok = read("disVec", pointsArray.disVec.data(), nbo)
+               && read("springVec", pointsArray.springVec.data(), nbo)
+               && read("cellRadiusBase", pointsArray.cellRadiusBase.data(), nbo)
+               && read("cellRadius", pointsArray.cellRadius.data(), nbo)
+               && read("myTotalHormone1", pointsArray.myTotalHormone1.data(), nbo)
+               && read("myDeltaHormone1", pointsArray.myDeltaHormone1.data(), nbo)
+               && read("myTotalHormone2", pointsArray.myTotalHormone2.data(), nbo)
+               && read("myDeltaHormone2", pointsArray.myDeltaHormone2.data(), nbo)
+               && read("isHormone1Producer", pointsArray.isHormone1Producer.data(), nbo)
+               && read("isHormone2Producer", pointsArray.isHormone2Producer.data(), nbo)
+               && read("cellId", pointsArray.cellId.data(), nbo)
+               && read("correction1", hormoneIMEX.correction1)
+               && read("correction2", hormoneIMEX.correction2)
+               && read("triVerts", leafMesh.triVerts)
+               && read("triNeigh", leafMesh.triNeigh)
+               && read("vertTri", leafMesh.vertTri)
+               && read("meshPos", leafMesh.meshPos)
+               && read("divisionTarget", divisionScheduler.target)
+               && read("divisionIntegrated", divisionScheduler.integrated)
+               && read("divisionHazard", divisionScheduler.hazard)
+               && read("divisionUpdated", divisionScheduler.updated);
+        if (!ok) return false;
+
+        currentTime = scalars.currentTime;
+        timestep = scalars.timestep;
+        hormoneLimit = scalars.hormoneLimit;
+        realTime = scalars.realTime;
+        stepCount = scalars.stepCount;
+        hormone1Started = scalars.hormone1Started;
+        hormone2Started = scalars.hormone2Started;
+        legacyRandom = scalars.random;
+        leafMesh.invalidate();
+        leafMesh.numVerts = scalars.meshNumVerts;
+        leafMesh.valid = scalars.meshValid;
+        divisionScheduler.hazardKey = scalars.hazardKey;
+        pointsArray.nextId = scalars.nextId;
+        divisionScheduler.rebuildQueue(divisionScheduler.target.size());
+        lastProgressLine = -1;
+        return true;
+    }
+
+private:
+    std::vector<char> data;
+    std::vector<CheckpointSection> table;
+
+    bool error(const char* path, const char* reason){
+        logMessage(LOG_ERROR, "Checkpoint `%s' cannot be used: %s\n", path, reason);
+        return false;
+    }
+
+    const CheckpointSection* find(const char* name, uint32_t elemSize) const{
+        for (size_t s = 0; s < table.size(); s++) {
+            if (strncmp(table[s].name, name, sizeof(table[s].name)) == 0) {
+                if (table[s].elemSize != elemSize) {
+                    logMessage(LOG_ERROR, "Checkpoint section `%s' has elements of %u bytes instead of %u\n",
+                               name, table[s].elemSize, elemSize);
+                    return NULL;
+                }
+                return &table[s];
+            }
+        }
+        logMessage(LOG_ERROR, "Checkpoint section `%s' is missing\n", name);
+        return NULL;
+    }
+
+    /// exactly count elements
+    template <typename T>
+    bool read(const char* name, T* out, size_t count){
+        const CheckpointSection* section = find(name, sizeof(T));
+        if (!section) return false;
+        if (section->count != count) {
+            logMessage(LOG_ERROR, "Checkpoint section `%s' has %llu elements instead of %zu\n",
+                       name, (unsigned long long)section->count, count);
+            return false;
+        }
+        memcpy((void*)out, data.data() + section->offset, count * sizeof(T));
+        return true;
+    }
+
+    /// all the elements of the section
+    template <typename T>
+    bool read(const char* name, std::vector<T>& out){
+        const CheckpointSection* section = find(name, sizeof(T));
+        if (!section) return false;
+        out.resize(section->count);
+        memcpy((void*)out.data(), data.data() + section->offset, section->count * sizeof(T));
+        return true;
+    }
+};
+
+
+/// save a checkpoint if checkpointPeriod has passed since the last one, to be called between steps
+void checkpointIfDue(){
+    if (checkpointPeriod <= 0) return;
+    double now = wallTime();
+    if (lastCheckpoint < 0) {
+        lastCheckpoint = now;   /// the first one is a period after the start
+    }
+    else if (now - lastCheckpoint >= checkpointPeriod) {
+        lastCheckpoint = now;
+        checkpointWriter.save(checkpointFile);
+    }
+}
+
+#endif //FRAP_CHECKPOINT_H
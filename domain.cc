@@ -0,0 +1,203 @@
+/*
+ * Distributed runner: one simulation cut into slabs of the leaf, one slab per rank (see domain.h)
+ * usage: leafsim_domain params.cym [ranks=N] [name=value...]
+ *            the ranks are threads of this process, talking through memory
+ *        leafsim_domain params.cym transport=tcp rank=K peers=host0:port0,host1:port1,... [name=value...]
+ *            one rank per process, started on each machine with its own rank= and the same peers=
+ *        mpirun -n N leafsim_domain params.cym transport=mpi [name=value...]
+ *            one rank per process, built with -DLEAFSIM_MPI=ON
+ * Every rank reads the same parameters. Rank 0 writes the progress, outputFourierCoeffs.csv and cellsFile.
+ */
+
+#define REPLICA_LOCAL thread_local   /// every rank has its own simulation state, see replica.h
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#define DEBUG false
+#define HEADLESS true   /// no window, so no GLFW or OpenGL
+#define MOVING_POINTS true
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "random.h"
+#include "vector.h"
+#include "param.h"
+#include "trace.h"
+#include "transport.h"
+#include "object.h"
+#include "polish.h"
+#include "arrays.h"
+#include "neighbours.h"
+#include "grid.h"
+#include "hormone.h"
+#include "Clarkson-Delaunay.cpp"
+#include "mesh.h"
+#include "springs.h"
+#include "simd.h"
+#include "fitness.h"
+#include "scheduler.h"
+#include "reorder.h"
+#include "domain.h"
+#include "simulation.h"
+
+
+/// the parameters of the run, the same for every rank
+struct DomainRun
+{
+    std::string paramsPath;
+    std::vector<std::string> options;
+};
+
+/// runs the slab of one rank to finalTime, with the state of the calling thread (REPLICA_LOCAL)
+void runRank(const DomainRun& run, Transport* link, StepResult& status){
+    transport = link;
+    replicaId = link->rank();
+    if (!isRootRank()) {
+        verbose = false;   /// rank 0 speaks for all
+    }
+    if (!run.paramsPath.empty()) {
+        readFile(run.paramsPath.c_str());
+    }
+    for (size_t i = 0; i < run.options.size(); i++) {
+        if (!readOption(run.options[i].c_str()) && isRootRank()) {
+            logMessage(LOG_WARNING, "Unknown argument `%s'\n", run.options[i].c_str());
+        }
+    }
+    if (!randomStreams) {
+        if (isRootRank()) {
+            logMessage(LOG_WARNING, "randomStreams=0 is one sequence for all the cells, it cannot be cut: using random streams\n");
+        }
+        randomStreams = true;
+    }
+#ifdef _OPENMP
+    omp_set_num_threads(1);   /// the ranks are the parallelism, and the OpenMP threads would not see this thread's state
+#endif
+    initSimulation();
+
+    do {
+        status = simulationStep();
+    } while (status == STEP_RUNNING);
+
+    std::vector<CellRecord> cells;
+    gatherCells(cells);
+    if (isRootRank() && status == STEP_FINISHED) {
+        std::sort(cells.begin(), cells.end(), [](const CellRecord& a, const CellRecord& b){ return a.id < b.id; });
+        std::vector<vector2D> positions(cells.size());
+        for (size_t c = 0; c < cells.size(); c++) {
+            positions[c] = cells[c].position;
+        }
+        int fourierCoeffsNum = numFourierCoeffs(cells.size());
+        double **fourierCoeffs = computeDeltaFourierCoeffs(fourierCoeffsNum, positions.data(), positions.size());
+        outputFourierToFile(fourierCoeffs, fourierCoeffsNum, "outputFourierCoeffs.csv");
+        for (int i = 0; i < fourierCoeffsNum; i++){
+            free(fourierCoeffs[i]);
+        }
+        free(fourierCoeffs);
+        if (!cellsFile.empty()) {
+            outputCellRecordsToFile(cells, cellsFile.c_str());
+        }
+        logMessage(LOG_INFO, "%zu cells on %d ranks, cut again %ld times, Fourier Coefficients Saved!\n",
+                   cells.size(), link->size(), numRebalances);
+    }
+    if (status == STEP_FAILED && isRootRank()) {
+        logMessage(LOG_ERROR, "The simulation failed at time %f\n", currentTime);
+    }
+}
+
+/// splits "a,b,c"
+std::vector<std::string> splitList(const std::string& list){
+    std::vector<std::string> items;
+    std::istringstream iss(list);
+    std::string item;
+    while (getline(iss, item, ',')) {
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+
+/* program entry */
+int main(int argc, char *argv[]) {
+    DomainRun run;
+    int ranks = std::max(1u, std::thread::hardware_concurrency());
+    int rank = 0;
+    std::string kind = "local";
+    std::string peers;
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        size_t n = strlen(arg);
+        if (n > 4 && strcmp(arg + n - 4, ".cym") == 0 && run.paramsPath.empty()) {
+            run.paramsPath = arg;
+            continue;
+        }
+        if ( readParameter(arg, "ranks=", ranks) ) continue;
+        if ( readParameter(arg, "rank=", rank) ) continue;
+        if ( readParameter(arg, "transport=", kind) ) continue;
+        if ( readParameter(arg, "peers=", peers) ) continue;
+        run.options.push_back(arg);   /// parameters of the simulation, read by every rank
+    }
+    if (run.paramsPath.empty()) {
+        printf(".cym file not found\n Using Defaults\n");
+    }
+
+    StepResult status = STEP_FAILED;
+    if (kind == "local") {
+        ranks = std::max(ranks, 1);
+        printf("Running on %d ranks in this process\n", ranks);
+        LocalExchange exchange(ranks);
+        std::vector<std::unique_ptr<LocalTransport>> links;
+        std::vector<StepResult> results(ranks, STEP_FAILED);
+        std::vector<std::thread> threads;
+        for (int r = 0; r < ranks; r++) {
+            links.emplace_back(new LocalTransport(exchange, r));
+            threads.push_back(std::thread(runRank, std::cref(run), links.back().get(), std::ref(results[r])));
+        }
+        for (int r = 0; r < ranks; r++) {
+            threads[r].join();
+        }
+        status = results[0];
+    }
+    else if (kind == "tcp") {
+        std::vector<std::string> addresses = splitList(peers);
+        if (rank < 0 || rank >= (int)addresses.size()) {
+            printf("transport=tcp needs rank=K and peers=host:port,... with an address for each rank\n");
+            return EXIT_FAILURE;
+        }
+        SocketTransport link(rank, addresses);
+        if (!link.ok) {
+            logFlush();
+            return EXIT_FAILURE;
+        }
+        runRank(run, &link, status);
+    }
+    else if (kind == "mpi") {
+#if LEAFSIM_MPI
+        MPI_Init(&argc, &argv);
+        {
+            MpiTransport link;
+            runRank(run, &link, status);   /// on the thread that called MPI_Init
+        }
+        MPI_Finalize();
+#else
+        printf("leafsim_domain was built without MPI (cmake -DLEAFSIM_MPI=ON)\n");
+        return EXIT_FAILURE;
+#endif
+    }
+    else {
+        printf("unknown transport `%s', use local, tcp or mpi\n", kind.c_str());
+        return EXIT_FAILURE;
+    }
+
+    logFlush();
+    return (status == STEP_FINISHED) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,393 @@
+//
+// One simulation cut into slabs of the leaf, each held by a rank (a thread or a process, see transport.h)
+//
+
+#ifndef FRAP_DOMAIN_H
+#define FRAP_DOMAIN_H
+#include <float.h>
+#include <algorithm>
+#include <vector>
+
+/// leafsim_domain cuts the leaf along x into one slab per rank, and each rank keeps the cells of its slab in its
+/// own pointsArray, so the ranks together can hold many times MAX cells. At every step, after the divisions,
+/// a rank copies the cells of its two neighbours that are within haloWidth spring reaches of its slab (positions,
+/// radii, hormones, producers) after its own cells, finds the springs over both, and moves and updates its own
+/// cells only. The copies are refreshed after each substep of the springs and of the hormones, and after each
+/// iteration of the IMEX diffusion solve, so that the own cells see the same neighbours as in the whole leaf.
+/// The timestep, the hormone limit, the number of cells and the producer of hormone 2 are reduced over the ranks.
+/// At the end of the step the copies are dropped and the cells that left the slab go to the rank next to it,
+/// with the state of their next division and of the IMEX solver.
+/// Every rebalancePeriod steps, if a rank holds more than rebalanceImbalance times the mean number of cells,
+/// the slabs are cut again at the quantiles of the positions, from a histogram summed over the ranks. No slab
+/// is narrower than the halo, so that the copies always come from the two neighbours: while the leaf is small
+/// the outer ranks stay empty, and take cells as it grows.
+/// The new cells of a step get their ids rank after rank, and the random streams follow the ids, so the
+/// divisions do not depend on the cut. The triangulation is rebuilt at every step over the own cells and the
+/// copies; along the outline near a cut it can differ from the one of the whole leaf (long edges), the contact
+/// grid (useContactGrid=1) finds exactly the same springs. With one rank the run is the same as leafsim's.
+/// With more, it is deterministic for a given number of ranks, but sums are done in another order and the
+/// dynamics amplify these differences, so it is only statistically equivalent to a run in one process.
+
+REPLICA_LOCAL std::vector<double> slabCuts;   /// slab of rank r: slabCuts[r] <= x < slabCuts[r+1]
+REPLICA_LOCAL int domainCells = 0;           /// the cells of all the ranks
+REPLICA_LOCAL long numRebalances = 0;
+
+/// the number of cells of the whole leaf
+int allCells(){
+    return transport ? domainCells : nbo;
+}
+
+/// the first of count consecutive ids for the new cells of this rank, the ranks taking them in turn
+int reserveCellIds(int count){
+    int first = pointsArray.nextId;
+    if (!transport) {
+        pointsArray.nextId += count;
+        return first;
+    }
+    static REPLICA_LOCAL std::vector<int> counts;
+    transport->allGather(count, counts);
+    int total = 0;
+    for (int r = 0; r < (int)counts.size(); r++) {
+        if (r < transport->rank()) first += counts[r];
+        total += counts[r];
+    }
+    pointsArray.nextId += total;
+    domainCells += total;
+    return first;
+}
+
+/// cells closer than this to the slab of another rank are copied to it
+double haloDistance(){
+    double maxRadius = 0;
+    for (int i = 0; i < ownedCells(); i++) {
+        maxRadius = std::max(maxRadius, pointsArray.cellRadius[i]);
+    }
+    return haloWidth * (1 + breakSpringCoeff) * globalMax(maxRadius);
+}
+
+/// what the neighbouring ranks need of a cell
+struct HaloCell
+{
+    vector2D position;
+    double radius, radiusBase, hormone1, hormone2;
+    int id;
+    char producer1, producer2;
+};
+
+/// everything about a cell that moves to another rank
+struct MigrantCell
+{
+    vector2D position, spring;
+    double radiusBase, radius, hormone1, delta1, hormone2, delta2;
+    double target, integrated, hazard, updated;   /// its next division (scheduler.h), target < 0 if not scheduled
+    double correction1, correction2;              /// the start of its next IMEX solve
+    int id;
+    char producer1, producer2;
+};
+
+REPLICA_LOCAL std::vector<char> domainOutLeft, domainOutRight, domainInLeft, domainInRight;
+REPLICA_LOCAL std::vector<int> domainKeep, domainLeft, domainRight;
+
+void packHalo(const std::vector<int>& cells, std::vector<char>& out){
+    out.resize(cells.size() * sizeof(HaloCell));
+    HaloCell* to = (HaloCell*)out.data();
+    for (size_t k = 0; k < cells.size(); k++) {
+        Point cell = pointsArray[cells[k]];
+        to[k] = {cell.disVec, cell.cellRadius, cell.cellRadiusBase, cell.myTotalHormone1, cell.myTotalHormone2,
+                 pointsArray.cellId[cells[k]], cell.isHormone1Producer, cell.isHormone2Producer};
+    }
+}
+
+void unpackHalo(const std::vector<char>& in, int start){
+    const HaloCell* from = (const HaloCell*)in.data();
+    int count = in.size() / sizeof(HaloCell);
+    for (int k = 0; k < count; k++) {
+        Point cell = pointsArray[start + k];
+        cell.disVec = from[k].position;
+        cell.springVec.setZeros();
+        cell.cellRadius = from[k].radius;
+        cell.cellRadiusBase = from[k].radiusBase;
+        cell.myTotalHormone1 = from[k].hormone1;
+        cell.myTotalHormone2 = from[k].hormone2;
+        cell.myDeltaHormone1 = 0;
+        cell.myDeltaHormone2 = 0;
+        cell.isHormone1Producer = from[k].producer1;
+        cell.isHormone2Producer = from[k].producer2;
+        pointsArray.cellId[start + k] = from[k].id;
+    }
+}
+
+/// copy the cells near the edges of the slab to the neighbouring ranks, and theirs after the own cells;
+/// false on every rank if a rank has no room for the copies
+bool exchangeHalo(){
+    if (!transport || transport->size() == 1) {
+        return true;
+    }
+    TRACE_SCOPE("halo");
+    int rank = transport->rank();
+    int left = rank - 1;
+    int right = (rank + 1 < transport->size()) ? rank + 1 : -1;
+    double distance = haloDistance();
+    int numOwned = nbo;
+
+    halo.sendLeft.clear();
+    halo.sendRight.clear();
+    for (int i = 0; i < numOwned; i++) {
+        double x = pointsArray.disVec[i].xx;
+        if (left >= 0 && x < slabCuts[rank] + distance) halo.sendLeft.push_back(i);
+        if (right >= 0 && x >= slabCuts[rank + 1] - distance) halo.sendRight.push_back(i);
+    }
+    packHalo(halo.sendRight, domainOutRight);
+    transport->sendReceive(right, domainOutRight.data(), domainOutRight.size(), left, domainInLeft);
+    packHalo(halo.sendLeft, domainOutLeft);
+    transport->sendReceive(left, domainOutLeft.data(), domainOutLeft.size(), right, domainInRight);
+
+    int leftCount = domainInLeft.size() / sizeof(HaloCell);
+    int rightCount = domainInRight.size() / sizeof(HaloCell);
+    bool room = numOwned + leftCount + rightCount < (int)MAX;
+    if (!room) {
+        logMessage(LOG_ERROR, "Rank %d has no room for %d cells and %d copies\n", rank, numOwned, leftCount + rightCount);
+    }
+    if (globalMin(room) == 0) {
+        return false;
+    }
+    halo.leftStart = numOwned;
+    halo.leftCount = leftCount;
+    halo.rightStart = numOwned + leftCount;
+    halo.rightCount = rightCount;
+    unpackHalo(domainInLeft, halo.leftStart);
+    unpackHalo(domainInRight, halo.rightStart);
+    halo.numCopies = leftCount + rightCount;
+    nbo = numOwned + halo.numCopies;
+    leafMesh.invalidate();   /// the copies are different at every step
+    return true;
+}
+
+/// forget the copies, only the own cells are left
+void dropHalo(){
+    nbo -= halo.numCopies;
+    pointsArray.clearCells(nbo, nbo + halo.numCopies);   /// the daughters of the next step are made there
+    halo.numCopies = 0;
+}
+
+void packMigrants(const std::vector<int>& cells, bool scheduled, std::vector<char>& out){
+    out.resize(cells.size() * sizeof(MigrantCell));
+    MigrantCell* to = (MigrantCell*)out.data();
+    const DivisionScheduler& scheduler = divisionScheduler;
+    const std::vector<double>& correction1 = hormoneIMEX.correction1;
+    const std::vector<double>& correction2 = hormoneIMEX.correction2;
+    for (size_t k = 0; k < cells.size(); k++) {
+        int i = cells[k];
+        Point cell = pointsArray[i];
+        to[k] = {cell.disVec, cell.springVec, cell.cellRadiusBase, cell.cellRadius,
+                 cell.myTotalHormone1, cell.myDeltaHormone1, cell.myTotalHormone2, cell.myDeltaHormone2,
+                 scheduled ? scheduler.target[i] : -1, scheduled ? scheduler.integrated[i] : 0,
+                 scheduled ? scheduler.hazard[i] : 0, scheduled ? scheduler.updated[i] : 0,
+                 (i < (int)correction1.size()) ? correction1[i] : 0, (i < (int)correction2.size()) ? correction2[i] : 0,
+                 pointsArray.cellId[i], cell.isHormone1Producer, cell.isHormone2Producer};
+    }
+}
+
+/// only the cells order[k] stay, becoming cell k
+void keepCells(const std::vector<int>& order, bool scheduled){
+    applyCellOrder(order);
+    if (scheduled) {
+        divisionScheduler.keep(order);
+    }
+    if (hormoneSolver == 1) {
+        for (std::vector<double>* correction : {&hormoneIMEX.correction1, &hormoneIMEX.correction2}) {
+            correction->resize(std::max((int)correction->size(), nbo), 0);
+            applyOrder(*correction, order);
+            correction->resize(order.size());
+        }
+    }
+    pointsArray.clearCells(order.size(), nbo);
+    nbo = order.size();
+}
+
+/// the cells of in after the others, false if there is no room for them
+/// A cell without the state of its next division, or after one, is started again by the scheduler at the next step.
+bool appendMigrants(const std::vector<char>& in){
+    const MigrantCell* from = (const MigrantCell*)in.data();
+    int count = in.size() / sizeof(MigrantCell);
+    for (int k = 0; k < count; k++) {
+        if (nbo >= (int)MAX - 1) {
+            return false;
+        }
+        int i = nbo++;
+        Point cell = pointsArray[i];
+        cell.disVec = from[k].position;
+        cell.springVec = from[k].spring;
+        cell.cellRadiusBase = from[k].radiusBase;
+        cell.cellRadius = from[k].radius;
+        cell.myTotalHormone1 = from[k].hormone1;
+        cell.myDeltaHormone1 = from[k].delta1;
+        cell.myTotalHormone2 = from[k].hormone2;
+        cell.myDeltaHormone2 = from[k].delta2;
+        cell.isHormone1Producer = from[k].producer1;
+        cell.isHormone2Producer = from[k].producer2;
+        pointsArray.cellId[i] = from[k].id;
+        if (from[k].target >= 0 && (int)divisionScheduler.target.size() == i) {
+            divisionScheduler.append(from[k].target, from[k].integrated, from[k].hazard, from[k].updated);
+        }
+        if (hormoneSolver == 1) {
+            hormoneIMEX.correction1.push_back(from[k].correction1);
+            hormoneIMEX.correction2.push_back(from[k].correction2);
+        }
+    }
+    return true;
+}
+
+/// the cells that left the slab go to the rank next to it, again until every cell is in its slab;
+/// false on every rank if a rank has no room for the cells it gets
+bool migrateCells(){
+    TRACE_SCOPE("migration");
+    int rank = transport->rank();
+    int left = rank - 1;
+    int right = (rank + 1 < transport->size()) ? rank + 1 : -1;
+    while (true) {
+        domainKeep.clear();
+        domainLeft.clear();
+        domainRight.clear();
+        for (int i = 0; i < nbo; i++) {
+            double x = pointsArray.disVec[i].xx;
+            if (left >= 0 && x < slabCuts[rank]) domainLeft.push_back(i);
+            else if (right >= 0 && x >= slabCuts[rank + 1]) domainRight.push_back(i);
+            else domainKeep.push_back(i);
+        }
+        bool scheduled = ((int)divisionScheduler.target.size() == nbo);
+        if (!scheduled) {
+            divisionScheduler.reset();   /// every cell will be started by the next update
+        }
+        packMigrants(domainLeft, scheduled, domainOutLeft);
+        packMigrants(domainRight, scheduled, domainOutRight);
+        keepCells(domainKeep, scheduled);
+
+        transport->sendReceive(right, domainOutRight.data(), domainOutRight.size(), left, domainInLeft);
+        transport->sendReceive(left, domainOutLeft.data(), domainOutLeft.size(), right, domainInRight);
+        bool room = appendMigrants(domainInLeft) && appendMigrants(domainInRight);
+        if (!room) {
+            logMessage(LOG_ERROR, "Rank %d has no room for the cells coming from its neighbours\n", rank);
+        }
+
+        double counts[2] = {(double)(domainLeft.size() + domainRight.size()), room ? 0.0 : 1.0};
+        transport->allReduce(counts, 2, REDUCE_SUM);
+        if (counts[1] > 0) return false;
+        if (counts[0] == 0) return true;
+    }
+}
+
+/// cut the leaf into slabs holding the same number of cells, from a histogram of the positions summed over the
+/// ranks; the slabs between two cuts are at least one halo wide, the last ones can be empty
+void cutSlabs(){
+    TRACE_SCOPE("rebalance");
+    int size = transport->size();
+    double bounds[2] = {-DBL_MAX, -DBL_MAX};   /// -xMin, xMax
+    for (int i = 0; i < nbo; i++) {
+        bounds[0] = std::max(bounds[0], -pointsArray.disVec[i].xx);
+        bounds[1] = std::max(bounds[1], pointsArray.disVec[i].xx);
+    }
+    transport->allReduce(bounds, 2, REDUCE_MAX);
+    double xMin = -bounds[0], xMax = bounds[1];
+    double distance = haloDistance();
+
+    slabCuts.assign(size + 1, 0);
+    slabCuts[0] = -DBL_MAX;
+    slabCuts[size] = DBL_MAX;
+    if (!(xMax > xMin)) {
+        for (int r = 1; r < size; r++) {
+            slabCuts[r] = xMax + r * distance;   /// one position or none: all on rank 0
+        }
+        return;
+    }
+
+    int numBins = 64 * size;
+    double binWidth = (xMax - xMin) / numBins;
+    std::vector<double> histogram(numBins, 0);
+    for (int i = 0; i < nbo; i++) {
+        int b = (int)((pointsArray.disVec[i].xx - xMin) / binWidth);
+        histogram[std::min(std::max(b, 0), numBins - 1)] += 1;
+    }
+    transport->allReduce(histogram.data(), numBins, REDUCE_SUM);
+    double total = 0;
+    for (int b = 0; b < numBins; b++) {
+        total += histogram[b];
+    }
+
+    /// the quantiles, interpolated within their bin
+    double below = 0;
+    int b = 0;
+    for (int r = 1; r < size; r++) {
+        double wanted = total * r / size;
+        while (b < numBins && below + histogram[b] < wanted) {
+            below += histogram[b++];
+        }
+        double fraction = (b < numBins && histogram[b] > 0) ? (wanted - below) / histogram[b] : 0;
+        double cut = xMin + (b + fraction) * binWidth;
+        if (r > 1) {
+            cut = std::max(cut, slabCuts[r - 1] + distance);
+        }
+        slabCuts[r] = cut;
+    }
+    numRebalances++;
+}
+
+/// after a step: drop the copies, send the cells that left the slab to their rank, and every rebalancePeriod
+/// steps cut the slabs again if the ranks are out of balance; false on every rank if a rank ran out of room
+bool finishDomainStep(int64_t step){
+    if (!transport) {
+        return true;
+    }
+    dropHalo();
+    if (transport->size() == 1) {
+        return true;
+    }
+    if (!migrateCells()) {
+        return false;
+    }
+    if (rebalancePeriod > 0 && step % rebalancePeriod == 0) {
+        double largest = globalMax(nbo);
+        double mean = (double)domainCells / transport->size();
+        if (largest > rebalanceImbalance * mean) {
+            cutSlabs();
+            return migrateCells();
+        }
+    }
+    return true;
+}
+
+/// after initSimulation() placed the cells, the same on every rank: rank 0 keeps them and sends them to their slabs
+void startDomain(){
+    if (!transport) {
+        return;
+    }
+    halo = Halo();
+    numRebalances = 0;
+    domainCells = nbo;
+    slabCuts.assign(transport->size() + 1, DBL_MAX);   /// everything in the slab of rank 0
+    slabCuts[0] = -DBL_MAX;
+    if (transport->rank() != 0) {
+        nbo = 0;
+    }
+    if (transport->size() > 1) {
+        cutSlabs();
+        migrateCells();
+    }
+}
+
+/// the cells of all the ranks at rank 0, none on the others
+void gatherCells(std::vector<CellRecord>& records){
+    cellRecords(records, ownedCells());
+    if (!transport) {
+        return;
+    }
+    std::vector<std::vector<char>> parts;
+    transport->gather(records.data(), records.size() * sizeof(CellRecord), parts);
+    records.clear();
+    for (size_t r = 0; r < parts.size(); r++) {
+        const CellRecord* from = (const CellRecord*)parts[r].data();
+        records.insert(records.end(), from, from + parts[r].size() / sizeof(CellRecord));
+    }
+}
+
+#endif //FRAP_DOMAIN_H
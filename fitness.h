@@ -4,24 +4,27 @@
 
 #ifndef FRAP_FITNESS_H
 #define FRAP_FITNESS_H
+#include <array>
 
 #endif //FRAP_FITNESS_H
 
-double** computeDeltaFourierCoeffs(int desiredNumFourierCoeffs) {
+/// the coefficients of the outline of the numCells cells at positions, on the heap as the leaf can be large
+double** computeDeltaFourierCoeffs(int desiredNumFourierCoeffs, const vector2D* positions, int numCells) {
+    TRACE_SCOPE("fourier");
     double **FourierCoeffs = (double **) malloc(desiredNumFourierCoeffs * sizeof(double *));
     for (int i = 0; i < desiredNumFourierCoeffs; i++) {
         FourierCoeffs[i] = (double *) malloc(2 * sizeof(double));
     }
-    double polarCoords[nbo][2];
+    std::vector<std::array<double, 2>> polarCoords(numCells);
 
-    for (int i = 0; i < nbo; i++) {
-        Point &cell = pointsArray[i];
-        polarCoords[i][0] = cell.disVec.magnitude();
-        polarCoords[i][1] = atan2(cell.disVec.yy, cell.disVec.xx);
+    for (int i = 0; i < numCells; i++) {
+        vector2D position = positions[i];
+        polarCoords[i][0] = position.magnitude();
+        polarCoords[i][1] = atan2(position.yy, position.xx);
     }
 
     double maxRadiusValue = 0;
-    for (int jj = 0; jj < nbo; jj++){
+    for (int jj = 0; jj < numCells; jj++){
         if (polarCoords[jj][0] > maxRadiusValue){
             maxRadiusValue = polarCoords[jj][0];
         }
@@ -34,24 +37,28 @@ double** computeDeltaFourierCoeffs(int desiredNumFourierCoeffs) {
         imgComp = 0;
 
         if (k == 0) {
-            for (int n = 0; n < nbo; n++) {
+            for (int n = 0; n < numCells; n++) {
                 double &radiusN = polarCoords[n][0];
                 double &thetaN = polarCoords[n][1];
 
-                realComp += 1.0/nbo * (radiusN / maxRadiusValue);
+                realComp += 1.0/numCells * (radiusN / maxRadiusValue);
             }
         } else {
-            for (int n = 0; n < nbo; n++) {
+            for (int n = 0; n < numCells; n++) {
                 double &radiusN = polarCoords[n][0];
                 double &thetaN = polarCoords[n][1];
-                realComp += 1.0/nbo * (radiusN / maxRadiusValue) * cos(k * thetaN);
-                imgComp += 1.0/nbo * (radiusN / maxRadiusValue) * sin(k * thetaN);
+                realComp += 1.0/numCells * (radiusN / maxRadiusValue) * cos(k * thetaN);
+                imgComp += 1.0/numCells * (radiusN / maxRadiusValue) * sin(k * thetaN);
             }
         }
     }
     return FourierCoeffs;
 }
 
+double** computeDeltaFourierCoeffs(int desiredNumFourierCoeffs) {
+    return computeDeltaFourierCoeffs(desiredNumFourierCoeffs, pointsArray.disVec.data(), nbo);
+}
+
 void printDeltaFourierCoeffs(double** inputFourierArray, int desiredNumOfFourierCoeffs){
     for (int m = 0; m<desiredNumOfFourierCoeffs; m++) {
         double &realValue = inputFourierArray[m][0];
@@ -63,6 +70,7 @@ void printDeltaFourierCoeffs(double** inputFourierArray, int desiredNumOfFourier
     }
 }
 
+#if !HEADLESS
 void reconstructShape(double** inputFourierArray, int desiredNumOfFourierCoeffs){
     double x, y;
     int numPoints = 3000; /// higher = smoother curve
@@ -102,11 +110,12 @@ void reconstructShape(double** inputFourierArray, int desiredNumOfFourierCoeffs)
     }
     glEnd();
 }
+#endif
 
 void outputFourierToFile(double** inputFourierArray, int desiredNumOfFourierCoeffs, const char* filename) {
     FILE *file = fopen(filename, "w");
     if (file == NULL) {
-        printf("Error opening file `%s'!\n", filename);
+        logMessage(LOG_ERROR, "Error opening file `%s'!\n", filename);
         exit(1);
     }
 
@@ -123,5 +132,46 @@ void outputFourierToFile(double** inputFourierArray, int desiredNumOfFourierCoef
     fclose(file);
 }
 
+/// what is written of a cell at the end of a run
+struct CellRecord
+{
+    int id;
+    vector2D position;
+    double radius, hormone1, hormone2;
+    char producer1, producer2;
+};
+
+/// the first numCells cells of pointsArray
+void cellRecords(std::vector<CellRecord>& records, int numCells) {
+    records.resize(numCells);
+    for (int i = 0; i < numCells; i++) {
+        Point cell = pointsArray[i];
+        records[i] = {pointsArray.cellId[i], cell.disVec, cell.cellRadius, cell.myTotalHormone1, cell.myTotalHormone2,
+                      cell.isHormone1Producer, cell.isHormone2Producer};
+    }
+}
 
+/// one row per cell, in the order of cellId so that files of the same run can be compared
+void outputCellRecordsToFile(std::vector<CellRecord>& records, const char* filename) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        logMessage(LOG_ERROR, "Error opening file `%s'!\n", filename);
+        return;
+    }
+    std::sort(records.begin(), records.end(), [](const CellRecord& a, const CellRecord& b){ return a.id < b.id; });
+
+    fprintf(file, "Id,X,Y,Radius,Hormone1,Hormone2,Producer1,Producer2\n");
+    for (size_t c = 0; c < records.size(); c++) {
+        const CellRecord& cell = records[c];
+        fprintf(file, "%d,%f,%f,%f,%f,%f,%d,%d\n", cell.id, cell.position.xx, cell.position.yy, cell.radius,
+                cell.hormone1, cell.hormone2, (int)cell.producer1, (int)cell.producer2);
+    }
 
+    fclose(file);
+}
+
+void outputCellsToFile(const char* filename) {
+    std::vector<CellRecord> records;
+    cellRecords(records, nbo);
+    outputCellRecordsToFile(records, filename);
+}
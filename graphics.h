@@ -114,7 +114,7 @@ static void drawTriangles(){
 static void drawConcaveHull(int* inputConcaveHullArray){
     for(int i = 0; i < nbo; i++){
         glBegin(GL_LINE_LOOP);
-        Point& p = pointsArray[inputConcaveHullArray[i]];
+        Point p = pointsArray[inputConcaveHullArray[i]];
         p.displayGreen(); // call displayGreen() using an object of the Point class
     }
     glEnd();
@@ -0,0 +1,127 @@
+//
+// Uniform grid (cell list) contact detection, an alternative to the delaunay triangulation
+//
+
+#ifndef FRAP_GRID_H
+#define FRAP_GRID_H
+#include <vector>
+#include <algorithm>
+
+/// A spring between two points only does something while their distance is below (1 + breakSpringCoeff)
+/// times the radius of one of them, so the contacts can be found without triangulating:
+/// the box [-xBound, xBound] x [-yBound, yBound] is cut into square bins at least as wide as the largest
+/// contact distance, the points are sorted into the bins (counting sort), and each point only looks at the
+/// points in its own bin and the 8 around it. Points outside the box go in the nearest border bin.
+/// A few points in a large box get narrower bins (see resize()), and then look as many bins around as
+/// the contact distance covers.
+/// Two points are neighbours if their distance is below (1 + breakSpringCoeff) * max(ri, rj), which is
+/// symmetric, so the graph can be turned into an EdgeList as the delaunay one is.
+class ContactGrid
+{
+public:
+    int numBinsX = 0, numBinsY = 0;
+    double binSize = 0;
+    int span = 1;   /// bins searched on each side of the bin of a point
+
+    /// fill graph with the contacts of the first numPoints points of pointsArray
+    void build(NeighbourGraph& graph, int numPoints){
+        TRACE_SCOPE("contact grid");
+        const vector2D* pos = pointsArray.disVec.data();
+        const double* radius = pointsArray.cellRadius.data();
+
+        double maxRadius = 0;
+        for (int i = 0; i < numPoints; i++) {
+            maxRadius = std::max(maxRadius, radius[i]);
+        }
+        double reach = (1 + breakSpringCoeff) * maxRadius;
+        resize(reach, numPoints);
+
+        /// sort the points into the bins
+        binOf.resize(numPoints);
+        binStart.assign(numBinsX * numBinsY + 1, 0);
+        for (int i = 0; i < numPoints; i++) {
+            binOf[i] = binIndex(pos[i]);
+            binStart[binOf[i] + 1]++;
+        }
+        for (int b = 0; b < numBinsX * numBinsY; b++) {
+            binStart[b+1] += binStart[b];
+        }
+        cursor.assign(binStart.begin(), binStart.end() - 1);
+        sorted.resize(numPoints);
+        for (int i = 0; i < numPoints; i++) {
+            sorted[cursor[binOf[i]]++] = i;
+        }
+
+        /// two passes over the same search, counting the neighbours then writing them, so that
+        /// the rows can be filled by several threads at once
+        graph.numPoints = numPoints;
+        graph.offsets.assign(numPoints + 1, 0);
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < numPoints; i++) {
+            graph.offsets[i+1] = visitContacts(i, pos, radius, NULL);
+        }
+        for (int i = 0; i < numPoints; i++) {
+            graph.offsets[i+1] += graph.offsets[i];
+        }
+        graph.indices.resize(graph.offsets[numPoints]);
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < numPoints; i++) {
+            visitContacts(i, pos, radius, graph.indices.data() + graph.offsets[i]);
+        }
+    }
+
+private:
+    std::vector<int> binOf;      /// bin of each point
+    std::vector<int> binStart;   /// start of each bin in sorted, numBins + 1 entries
+    std::vector<int> sorted;     /// the points, bin after bin
+    std::vector<int> cursor;     /// write position in each bin while sorting
+
+    /// bins at least reach wide, with no more than about 4 bins per point, so that a few cells
+    /// in a large box do not cost a huge empty grid
+    void resize(double reach, int numPoints){
+        double width = 2 * xBound, height = 2 * yBound;
+        binSize = std::max(reach, 1e-9 * std::max(width, height));
+        double maxBins = std::max(64.0, 4.0 * numPoints);
+        if ((width / binSize) * (height / binSize) > maxBins) {
+            binSize = sqrt(width * height / maxBins);
+        }
+        numBinsX = std::max(1, (int)(width / binSize));
+        numBinsY = std::max(1, (int)(height / binSize));
+        span = std::max(1, (int)ceil(reach / binSize));
+    }
+
+    int binIndex(const vector2D& p) const{
+        int bx = (int)floor((p.xx + xBound) / binSize);
+        int by = (int)floor((p.yy + yBound) / binSize);
+        bx = std::min(std::max(bx, 0), numBinsX - 1);
+        by = std::min(std::max(by, 0), numBinsY - 1);
+        return by * numBinsX + bx;
+    }
+
+    /// count the contacts of point i, and write them to out if it is not NULL
+    int visitContacts(int i, const vector2D* pos, const double* radius, int* out) const{
+        int bx = binOf[i] % numBinsX, by = binOf[i] / numBinsX;
+        int count = 0;
+        for (int y = std::max(by - span, 0); y <= std::min(by + span, numBinsY - 1); y++) {
+            for (int x = std::max(bx - span, 0); x <= std::min(bx + span, numBinsX - 1); x++) {
+                int b = y * numBinsX + x;
+                for (int k = binStart[b]; k < binStart[b+1]; k++) {
+                    int j = sorted[k];
+                    if (j == i) continue;
+                    double dx = pos[j].xx - pos[i].xx;
+                    double dy = pos[j].yy - pos[i].yy;
+                    double reach = (1 + breakSpringCoeff) * std::max(radius[i], radius[j]);
+                    if (dx * dx + dy * dy < reach * reach) {
+                        if (out) out[count] = j;
+                        count++;
+                    }
+                }
+            }
+        }
+        return count;
+    }
+};
+
+REPLICA_LOCAL ContactGrid contactGrid;   /// used instead of the triangulation when useContactGrid is set
+
+#endif //FRAP_GRID_H
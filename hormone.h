@@ -8,10 +8,13 @@
 
 #endif //FRAP_HORMONE_H
 
+/// set once the producers of each hormone are chosen, kept in checkpoints
+REPLICA_LOCAL bool hormone1Started = false;
+REPLICA_LOCAL bool hormone2Started = false;
+
 void startHormoneBD(double inputStartTime){
-    static bool flag = false;
-    if ((currentTime > inputStartTime) and (flag == false)){
-        flag = true;
+    if ((currentTime > inputStartTime) and (hormone1Started == false)){
+        hormone1Started = true;
         /// find the point closest to the hormone Origin
         int closest_point_index = -1;
         double squareMinDist = 1000*1000*xBound;
@@ -24,15 +27,19 @@ void startHormoneBD(double inputStartTime){
         }
         /// set this point as the hormone producer
         pointsArray[closest_point_index].isHormone1Producer = true;
-        printf("Closest point is point %d\n", closest_point_index);
+        if (verbose) {
+            logMessage(LOG_DEBUG, "Closest point is point %d\n", closest_point_index);
+        }
     }
     else{
     }
 }
 
 void calcHormBirthDeath(){
+    TRACE_SCOPE("birth-death");
+#pragma omp parallel for schedule(static)
     for (int i = 0; i < nbo; i++){
-        Point& cell = pointsArray[i]; /// alias for pointsArray[i]
+        Point cell = pointsArray[i]; /// alias for pointsArray[i]
         /// calculate amount of hormone made by producers
         if ((cell.isHormone1Producer == true)){
             cell.produceHormone1BD(hormone1ProdRate);
@@ -44,23 +51,27 @@ void calcHormBirthDeath(){
     }
 }
 
-void hormReactDiffuse(double inputStartTime) {
-    static bool flag = false;
-    if ((currentTime > inputStartTime) and (flag == false)) {
-        flag = true;
+/// once currentTime passes inputStartTime, make the points closest to horm2Source1 produce hormone 2
+void setHormone2Producers(double inputStartTime) {
+    if ((currentTime > inputStartTime) and (hormone2Started == false)) {
+        hormone2Started = true;
         /// find the point closest to the hormone Origin
         int closest_point_source1_index = -1;
         int closest_point_source2_index = -1;
         double squareMinDist1 = 1000 * 1000 * xBound;
-        for (int i = 0; i < nbo; i++) {
+        int numOwned = ownedCells();   /// not the copies of the cells of other ranks (domain.h)
+        for (int i = 0; i < numOwned; i++) {
             double squareDisFromOrigin = (pointsArray[i].disVec - horm2Source1).magnitude_squared();
             if (squareDisFromOrigin < squareMinDist1) {
                 squareMinDist1 = squareDisFromOrigin;
                 closest_point_source1_index = i;
             }
         }
+        if (!globalArgMin(squareMinDist1)) {
+            return;   /// the closest cell is on another rank
+        }
         double squareMinDist2 = 1000 * 1000 * xBound;
-        for (int k = 0; k < nbo; k++) {
+        for (int k = 0; k < numOwned; k++) {
             double squareDisFromOrigin = (pointsArray[k].disVec - horm2Source1).magnitude_squared();
             if (squareDisFromOrigin < squareMinDist1) {
                 squareMinDist2 = squareDisFromOrigin;
@@ -68,11 +79,19 @@ void hormReactDiffuse(double inputStartTime) {
             }
             /// set this point as the hormone producer
             pointsArray[closest_point_source1_index].isHormone2Producer = true;
-            pointsArray[closest_point_source2_index].isHormone2Producer = true;
+            if (closest_point_source2_index != -1) {   /// not found yet, would write before the start of pointsArray
+                pointsArray[closest_point_source2_index].isHormone2Producer = true;
+            }
         }
     }
+}
+
+void hormReactDiffuse(double inputStartTime) {
+    TRACE_SCOPE("reaction");
+    setHormone2Producers(inputStartTime);
+#pragma omp parallel for schedule(static)
     for (int i = 0; i < nbo; i++) {
-        Point &cell = pointsArray[i]; /// alias for pointsArray[i]
+        Point cell = pointsArray[i]; /// alias for pointsArray[i]
         /// in reaction diffusion all cells produce horm1
         if (cell.isHormone2Producer == true) {
             cell.produceHormone1ReactD( RDfeedRate);
@@ -88,34 +107,88 @@ void hormReactDiffuse(double inputStartTime) {
     }
 }
 
-void v1DiffuseHorm(int** neighbourhoods) {
+/// diffusion along each edge of the triangulation, computed once per edge then summed by each point
+/// each end of an edge passes hormone in proportion to its radius (as v1DiffuseHorm does from both ends),
+/// unless the points overlap as seen from that end
+/// the flux is a rate that updateTotalHormone() multiplies by the timestep, the referenceTimestep factor
+/// is part of the calibrated diffusion constant and does not change with an adaptive step
+void v2DiffuseHorm(const EdgeList& edges) {
+    TRACE_SCOPE("diffusion");
+    static REPLICA_LOCAL std::vector<double> flux1, flux2;   /// hormone moving from first to second along each edge
+    int numEdges = edges.size();
+    flux1.resize(numEdges);
+    flux2.resize(numEdges);
+
+    std::vector<vector2D>& disVec = pointsArray.disVec;
+    std::vector<double>& cellRadius = pointsArray.cellRadius;
+    std::vector<double>& totalHormone1 = pointsArray.myTotalHormone1;
+    std::vector<double>& totalHormone2 = pointsArray.myTotalHormone2;
+
+#pragma omp parallel for schedule(static)
+    for (int e = 0; e < numEdges; e++) {
+        int i = edges.first[e], j = edges.second[e];
+        double squareDistance = (disVec[j] - disVec[i]).magnitude_squared();
+        double width = 0;
+        if (!(squareDistance < (0.2 * cellRadius[i] * 0.2 * cellRadius[i]))) width += cellRadius[i];
+        if (!(squareDistance < (0.2 * cellRadius[j] * 0.2 * cellRadius[j]))) width += cellRadius[j];
+        if (width == 0) {
+            flux1[e] = 0;   /// stops diffusion if points overlap
+            flux2[e] = 0;
+            continue;
+        }
+        double magnitudeOfDistance = (disVec[i] - disVec[j]).magnitude(); // m
+        double hormone1ConcnGrad = (totalHormone1[i] - totalHormone1[j]) / (magnitudeOfDistance * magnitudeOfDistance); //n / m^2
+        double hormone2ConcnGrad = (totalHormone2[i] - totalHormone2[j]) / (magnitudeOfDistance * magnitudeOfDistance);
+        flux1[e] = referenceTimestep*(hormone1DiffCoeff * hormone1ConcnGrad * width); //  n = t * (m^2/t * n/m * m)
+        flux2[e] = referenceTimestep*(hormone2DiffCoeff * hormone2ConcnGrad * width);
+    }
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < nbo; i++) {
+        double delta1 = 0, delta2 = 0;
+        for (int k = edges.incidentOffsets[i]; k < edges.incidentOffsets[i+1]; k++) {
+            int e = edges.incident[k];
+            if (edges.first[e] == i) {
+                delta1 -= flux1[e];
+                delta2 -= flux2[e];
+            }
+            else {
+                delta1 += flux1[e];
+                delta2 += flux2[e];
+            }
+        }
+        pointsArray.myDeltaHormone1[i] += delta1;
+        pointsArray.myDeltaHormone2[i] += delta2;
+    }
+}
+
+void v1DiffuseHorm(const NeighbourGraph& graph) {
+    TRACE_SCOPE("diffusion");
 
     for (int i = 0; i < nbo; i++) { ///for each primary point in pointsArray (iterates through each point using i)
-        Point &centre = pointsArray[i]; /// alias for pointsArray[i]
-        for (int l = 0; l < NAW; l++) {
-            Point &neighbour = pointsArray[neighbourhoods[i][l]];
-            if (neighbourhoods[i][l] != -1) {
-                /// using squared magnitudes here is computationally faster
-                if ((neighbour.disVec - centre.disVec).magnitude_squared() <
-                    (0.2 * centre.cellRadius * 0.2 * centre.cellRadius)) {
-                } /// stops diffusion if points overlap
-                else {
-                    /// find the magnitude of distance between the neighbouring point and the central point
-                    double magnitudeOfDistance = (centre.disVec - neighbour.disVec).magnitude(); // m
-
-                    /// find difference in hormone amount between cells
-                    double hormone1ConcnDiff = centre.myTotalHormone1 - neighbour.myTotalHormone1;  //n / m
-                    double hormone2ConcnDiff = centre.myTotalHormone2 - neighbour.myTotalHormone2;
-
-                    double hormone1ConcnGrad = hormone1ConcnDiff / (magnitudeOfDistance * magnitudeOfDistance); //n / m^2
-                    double hormone2ConcnGrad = hormone2ConcnDiff / (magnitudeOfDistance * magnitudeOfDistance);
-                    /// diffuse the hormone from the centre to neighbour
-                    neighbour.myDeltaHormone1 += timestep*(hormone1DiffCoeff * hormone1ConcnGrad * centre.cellRadius); //  n = t * (m^2/t * n/m * m)
-                    centre.myDeltaHormone1 -= timestep*(hormone1DiffCoeff * hormone1ConcnGrad * centre.cellRadius);
-
-                    neighbour.myDeltaHormone2 += timestep*(hormone2DiffCoeff * hormone2ConcnGrad * centre.cellRadius); //  n = t * (m^2/t * n/m * m)
-                    centre.myDeltaHormone2 -= timestep*(hormone2DiffCoeff * hormone2ConcnGrad * centre.cellRadius);
-                }
+        Point centre = pointsArray[i]; /// alias for pointsArray[i]
+        for (int l = graph.begin(i); l < graph.end(i); l++) {
+            Point neighbour = pointsArray[graph.indices[l]];
+            /// using squared magnitudes here is computationally faster
+            if ((neighbour.disVec - centre.disVec).magnitude_squared() <
+                (0.2 * centre.cellRadius * 0.2 * centre.cellRadius)) {
+            } /// stops diffusion if points overlap
+            else {
+                /// find the magnitude of distance between the neighbouring point and the central point
+                double magnitudeOfDistance = (centre.disVec - neighbour.disVec).magnitude(); // m
+
+                /// find difference in hormone amount between cells
+                double hormone1ConcnDiff = centre.myTotalHormone1 - neighbour.myTotalHormone1;  //n / m
+                double hormone2ConcnDiff = centre.myTotalHormone2 - neighbour.myTotalHormone2;
+
+                double hormone1ConcnGrad = hormone1ConcnDiff / (magnitudeOfDistance * magnitudeOfDistance); //n / m^2
+                double hormone2ConcnGrad = hormone2ConcnDiff / (magnitudeOfDistance * magnitudeOfDistance);
+                /// diffuse the hormone from the centre to neighbour
+                neighbour.myDeltaHormone1 += referenceTimestep*(hormone1DiffCoeff * hormone1ConcnGrad * centre.cellRadius); //  n = t * (m^2/t * n/m * m)
+                centre.myDeltaHormone1 -= referenceTimestep*(hormone1DiffCoeff * hormone1ConcnGrad * centre.cellRadius);
+
+                neighbour.myDeltaHormone2 += referenceTimestep*(hormone2DiffCoeff * hormone2ConcnGrad * centre.cellRadius); //  n = t * (m^2/t * n/m * m)
+                centre.myDeltaHormone2 -= referenceTimestep*(hormone2DiffCoeff * hormone2ConcnGrad * centre.cellRadius);
             }
         }
     }
@@ -123,7 +196,7 @@ void v1DiffuseHorm(int** neighbourhoods) {
     double sumHorm2 = 0;
 
     for (int j = 0; j < nbo; j++) {
-        Point &cell = pointsArray[j];
+        Point cell = pointsArray[j];
 
         sumHorm1 += cell.myTotalHormone1;
         sumHorm2 += cell.myTotalHormone2;
@@ -133,17 +206,180 @@ printf("The sum of hormone1 is %f\nThe sum of hormone 2 is %f \n", sumHorm1, sum
 #endif
 }
 
+/// IMEX update of both hormones over one timestep, used instead of calcHormBirthDeath(), v2DiffuseHorm(),
+/// hormReactDiffuse() and globalUpdateHormone() when hormoneSolver = 1. The step is split in two:
+///   - the reactions (birth-death of hormone 1 and the Gray-Scott terms) of each cell are integrated with
+///     backward Euler, solving the 2x2 nonlinear system of the cell with a few Newton iterations
+///   - the diffusion is integrated with backward Euler, (I + dt L) H = H_reacted, where L is the graph
+///     Laplacian of v2DiffuseHorm (the same edge weights), solved by conjugate gradients
+/// Both are unconditionally stable, so the step is only limited by accuracy. The rates are the ones of the
+/// explicit functions, so for small steps both solvers give the same results.
+class HormoneIMEX
+{
+public:
+    int lastIterations1 = 0, lastIterations2 = 0;   /// conjugate gradient iterations of the last step
+    std::vector<double> correction1, correction2; /// change made by the last diffusion solve, the start of the next one
+
+    void step(const EdgeList& edges, double dt){
+        int numPoints = nbo;
+        numOwned = ownedCells();
+        react(dt, numPoints);
+        edgeWeights(edges);
+        lastIterations1 = solveDiffusion(edges, dt * hormone1DiffCoeff, pointsArray.myTotalHormone1, correction1, numPoints);
+        lastIterations2 = solveDiffusion(edges, dt * hormone2DiffCoeff, pointsArray.myTotalHormone2, correction2, numPoints);
+    }
+
+private:
+    std::vector<double> weight;                   /// per edge: referenceTimestep * width / distance^2, as in v2DiffuseHorm
+    std::vector<double> rhs, residual, direction, product;
+    int numOwned = 0;   /// the sums are over the cells of this rank, the copies of other ranks follow (domain.h)
+
+    /// backward Euler on the reactions of each cell, which do not depend on the other cells
+    void react(double dt, int numPoints){
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < numPoints; i++) {
+            double u0 = pointsArray.myTotalHormone1[i], v0 = pointsArray.myTotalHormone2[i];
+            double source1 = pointsArray.isHormone1Producer[i] ? hormone1ProdRate : 0;
+            double source2 = pointsArray.isHormone2Producer[i] ? RDfeedRate : 0;
+            double u = u0, v = v0;
+            for (int iteration = 0; iteration < 20; iteration++) {
+                /// the same terms as the explicit functions of Point
+                double reaction = reactRate1to2 * u * v * v;
+                double f = source1 + hormone1DegRate * u + RDfeedRate * (1 - u) - reaction;
+                double g = source2 - (RDfeedRate + RDkillRate) * v + reaction;
+                double r1 = u - u0 - dt * f;
+                double r2 = v - v0 - dt * g;
+                double a = 1 - dt * (hormone1DegRate - RDfeedRate - reactRate1to2 * v * v);
+                double b = dt * 2 * reactRate1to2 * u * v;
+                double c = -dt * reactRate1to2 * v * v;
+                double d = 1 - dt * (-(RDfeedRate + RDkillRate) + 2 * reactRate1to2 * u * v);
+                double det = a * d - b * c;
+                if (det == 0) break;
+                double du = (d * r1 - b * r2) / det;
+                double dv = (a * r2 - c * r1) / det;
+                u -= du;
+                v -= dv;
+                if (fabs(du) <= 1e-12 * (1 + fabs(u)) && fabs(dv) <= 1e-12 * (1 + fabs(v))) break;
+            }
+            pointsArray.myTotalHormone1[i] = std::max(u, 0.0);
+            pointsArray.myTotalHormone2[i] = std::max(v, 0.0);
+            pointsArray.myDeltaHormone1[i] = 0;
+            pointsArray.myDeltaHormone2[i] = 0;
+        }
+    }
+
+    void edgeWeights(const EdgeList& edges){
+        int numEdges = edges.size();
+        weight.resize(numEdges);
+        std::vector<vector2D>& disVec = pointsArray.disVec;
+        std::vector<double>& cellRadius = pointsArray.cellRadius;
+#pragma omp parallel for schedule(static)
+        for (int e = 0; e < numEdges; e++) {
+            int i = edges.first[e], j = edges.second[e];
+            double squareDistance = (disVec[j] - disVec[i]).magnitude_squared();
+            double width = 0;
+            if (!(squareDistance < (0.2 * cellRadius[i] * 0.2 * cellRadius[i]))) width += cellRadius[i];
+            if (!(squareDistance < (0.2 * cellRadius[j] * 0.2 * cellRadius[j]))) width += cellRadius[j];
+            weight[e] = (width == 0) ? 0 : referenceTimestep * width / squareDistance;
+        }
+    }
+
+    /// out = (I + scale L) x
+    void applyOperator(const EdgeList& edges, double scale, const std::vector<double>& x, std::vector<double>& out, int numPoints){
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < numPoints; i++) {
+            double sum = 0;
+            for (int k = edges.incidentOffsets[i]; k < edges.incidentOffsets[i+1]; k++) {
+                int e = edges.incident[k];
+                int j = (edges.first[e] == i) ? edges.second[e] : edges.first[e];
+                sum += weight[e] * (x[i] - x[j]);
+            }
+            out[i] = x[i] + scale * sum;
+        }
+    }
+
+    double dot(const std::vector<double>& a, const std::vector<double>& b, int numPoints){
+        double sum = 0;
+        int count = std::min(numPoints, numOwned);
+#pragma omp parallel for schedule(static) reduction(+:sum)
+        for (int i = 0; i < count; i++) {
+            sum += a[i] * b[i];
+        }
+        return globalSum(sum);
+    }
+
+    /// solve (I + scale L) x = amount in place, starting from amount plus the previous correction
+    int solveDiffusion(const EdgeList& edges, double scale, std::vector<double>& amount, std::vector<double>& correction, int numPoints){
+        const double tolerance = 1e-10;
+        const int maxIterations = 500;
+        correction.resize(numPoints, 0);   /// new cells start with no correction
+        rhs.assign(amount.begin(), amount.begin() + numPoints);
+        residual.resize(numPoints);
+        direction.resize(numPoints);
+        product.resize(numPoints);
+
+        for (int i = 0; i < numPoints; i++) {
+            amount[i] = rhs[i] + correction[i];
+        }
+        refreshHalo(amount.data());
+        applyOperator(edges, scale, amount, product, numPoints);
+        for (int i = 0; i < numPoints; i++) {
+            residual[i] = rhs[i] - product[i];
+            direction[i] = residual[i];
+        }
+        refreshHalo(direction.data());
+        double limit = tolerance * tolerance * std::max(dot(rhs, rhs, numPoints), DBL_MIN);
+        double residualNorm = dot(residual, residual, numPoints);
+        int iteration = 0;
+        while (residualNorm > limit && iteration < maxIterations) {
+            applyOperator(edges, scale, direction, product, numPoints);
+            double alpha = residualNorm / dot(direction, product, numPoints);
+#pragma omp parallel for schedule(static)
+            for (int i = 0; i < numPoints; i++) {
+                amount[i] += alpha * direction[i];
+                residual[i] -= alpha * product[i];
+            }
+            double newNorm = dot(residual, residual, numPoints);
+            double beta = newNorm / residualNorm;
+            residualNorm = newNorm;
+#pragma omp parallel for schedule(static)
+            for (int i = 0; i < numPoints; i++) {
+                direction[i] = residual[i] + beta * direction[i];
+            }
+            refreshHalo(direction.data());
+            iteration++;
+        }
+
+        for (int i = 0; i < numPoints; i++) {
+            correction[i] = amount[i] - rhs[i];
+            if (amount[i] < 0) amount[i] = 0;
+        }
+        return iteration;
+    }
+};
+
+REPLICA_LOCAL HormoneIMEX hormoneIMEX;
+
+/// one IMEX step of the hormones, replaces the explicit sequence of the main loop
+void imexUpdateHormone(const EdgeList& edges, double inputStartTime){
+    TRACE_SCOPE("hormones IMEX");
+    setHormone2Producers(inputStartTime);
+    hormoneIMEX.step(edges, timestep);
+}
+
 double sumHormone2(){
     double sumHorm1 = 0;
     double sumHorm2 = 0;
 
-    for (int j = 0; j < nbo; j++) {
-        Point &cell = pointsArray[j];
+    int numOwned = ownedCells();
+#pragma omp parallel for schedule(static) reduction(+:sumHorm1, sumHorm2)
+    for (int j = 0; j < numOwned; j++) {
+        Point cell = pointsArray[j];
 
         sumHorm1 += cell.myTotalHormone1;
         sumHorm2 += cell.myTotalHormone2;
     }
-    return sumHorm2;
+    return globalSum(sumHorm2);
 }
 
 double findMaxHormone1(){
@@ -186,7 +422,32 @@ double findMinHormone2(){
     return minHormone;
 }
 
+/// the largest step for which, at the rates of change summed up this step, no hormone amount changes by more
+/// than hormoneTolerance of the largest amount; call before globalUpdateHormone(), which clears the rates
+double hormoneStepLimit(){
+    double max1 = 0, max2 = 0, rate1 = 0, rate2 = 0;
+    int numOwned = ownedCells();
+#pragma omp parallel for schedule(static) reduction(max:max1, max2, rate1, rate2)
+    for (int i = 0; i < numOwned; i++) {
+        max1 = std::max(max1, pointsArray.myTotalHormone1[i]);
+        max2 = std::max(max2, pointsArray.myTotalHormone2[i]);
+        rate1 = std::max(rate1, fabs(pointsArray.myDeltaHormone1[i]));
+        rate2 = std::max(rate2, fabs(pointsArray.myDeltaHormone2[i]));
+    }
+    if (transport) {
+        double maxima[4] = {max1, max2, rate1, rate2};
+        transport->allReduce(maxima, 4, REDUCE_MAX);
+        max1 = maxima[0], max2 = maxima[1], rate1 = maxima[2], rate2 = maxima[3];
+    }
+    double limit = DBL_MAX;
+    if (max1 > 0 && rate1 > 0) limit = std::min(limit, hormoneTolerance * max1 / rate1);
+    if (max2 > 0 && rate2 > 0) limit = std::min(limit, hormoneTolerance * max2 / rate2);
+    return limit;
+}
+
 void globalUpdateHormone(){
+    TRACE_SCOPE("hormone update");
+#pragma omp parallel for schedule(static)
     for (int i = 0; i<nbo; i++){
         pointsArray[i].updateTotalHormone();
     }
@@ -194,7 +455,7 @@ void globalUpdateHormone(){
 
 void hormoneExpandEffect(){
     for (int i = 0; i < nbo; i++){
-        Point& centre = pointsArray[i];
+        Point centre = pointsArray[i];
         centre.cellRadius = centre.cellRadiusBase + (horm1Efficacy * centre.myTotalHormone1 * SCALING_FACTOR);
     }
 }
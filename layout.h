@@ -0,0 +1,109 @@
+//
+// Initial positions of the cells, other than the random ones of CellStore::placeRandomly()
+//
+
+#ifndef FRAP_LAYOUT_H
+#define FRAP_LAYOUT_H
+
+void initRegularTriangularLattice() {
+    int index = 0;
+    bool isSqrtNBOWhole = !fmod(sqrt(nbo), 1);
+
+    int numPointsX = sqrt(nbo);
+    int numPointsY = sqrt(nbo);
+    double spacing = pointsArray[0].cellRadius*2;
+    double xSum = 0.0, ySum = 0.0;
+    int numPoints = numPointsX * numPointsY;
+    if (isSqrtNBOWhole){
+        for (int i = 0; i < numPointsX; i++) {
+            for (int j = 0; j < numPointsY; j++) {
+                double x = i * spacing + ((j % 2 == 0) ? 0 : spacing / 2.0);
+                double y = j * spacing * sin(M_PI / 3.0);
+                Point p = pointsArray[index];
+                p.disVec = vector2D(x, y);
+                xSum += x;
+                ySum += y;
+                index++;
+            }
+        }
+        double xCenter = xSum / numPoints;
+        double yCenter = ySum / numPoints;
+        for (int i = 0; i < numPoints; i++) {
+            pointsArray[i].disVec -= vector2D(xCenter, yCenter);
+        }
+    }
+    else{
+        printf("NBO DOES NOT EQUAL numPointsX * numPointsY\n");
+    }
+}
+
+void initPerfectCircle(double circleRadius) {
+    int index = 0;
+    double angleSpacing = 2 * M_PI / nbo;
+    double xSum = 0.0, ySum = 0.0;
+
+    for (int i = 0; i < nbo; i++) {
+        double angle = 2 * i * angleSpacing;
+        double x = circleRadius * cos(angle);
+        double y = circleRadius * sin(angle);
+        Point p = pointsArray[index];
+        p.disVec = vector2D(x, y);
+        xSum += x;
+        ySum += y;
+        index++;
+    }
+
+    double xCenter = xSum / nbo;
+    double yCenter = ySum / nbo;
+    for (int i = 0; i < nbo; i++) {
+        pointsArray[i].disVec -= vector2D(xCenter, yCenter);
+    }
+}
+
+void initHollowSquare(double sideLength, int nbo) {
+    int pointsPerSide = nbo / 4;
+    double spacing = sideLength / (pointsPerSide);
+    double xSum = 0.0, ySum = 0.0;
+
+    for (int i = 0; i < nbo; i++) {
+        int side = i / pointsPerSide;
+        int j = i % pointsPerSide;
+        double x, y;
+
+        if (side == 0) {
+            x = j * spacing - sideLength / 2;
+            y = -sideLength / 2;
+        } else if (side == 1) {
+            x = sideLength / 2;
+            y = j * spacing - sideLength / 2;
+        } else if (side == 2) {
+            x = sideLength / 2 - j * spacing;
+            y = sideLength / 2;
+        } else { // side == 3
+            x = -sideLength / 2;
+            y = sideLength / 2 - j * spacing;
+        }
+
+        Point p = pointsArray[i];
+        p.disVec = vector2D(x, y);
+        xSum += x;
+        ySum += y;
+    }
+
+    double xCenter = xSum / nbo;
+    double yCenter = ySum / nbo;
+    for (int i = 0; i < nbo; i++) {
+        pointsArray[i].disVec -= vector2D(xCenter, yCenter);
+    }
+}
+
+/// nbo cells at random in a square centred on the origin
+void initRandomSquare(double sideLength) {
+    for (int i = 0; i < nbo; i++) {
+        RandomStream random(seed, RANDOM_LAYOUT, 0, pointsArray.cellId[i]);
+        double x = random.srand();
+        pointsArray[i].disVec = 0.5 * sideLength * vector2D(x, random.srand());
+    }
+}
+
+#endif //FRAP_LAYOUT_H
@@ -0,0 +1,46 @@
+//
+// C interface of the leafsim_core library, to run simulations from another programme (GA/leafsim.py)
+//
+
+#ifndef FRAP_LEAFSIM_H
+#define FRAP_LEAFSIM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// A simulation owned by the caller. Each one keeps its state on a thread of its own (see replica.h),
+/// so several can exist at once, and each call waits for the simulation to finish the work.
+typedef struct LeafSim LeafSim;
+
+/// values returned by sim_step(), the same as StepResult
+enum
+{
+    SIM_RUNNING = 0,    /// finalTime is not reached yet
+    SIM_FINISHED = 1,   /// finalTime is reached
+    SIM_FAILED = 2      /// the hormones went NaN
+};
+
+/// new simulation with the default parameters changed by params, name=value pairs as in a .cym file,
+/// separated by spaces or new lines (it can be NULL). Returns NULL if a parameter is not known.
+LeafSim* sim_create(const char* params);
+
+/// advance by n steps, or up to finalTime if n <= 0, stopping early if the simulation ends
+int sim_step(LeafSim* sim, int n);
+
+/// write the Fourier coefficients of the current shape to coeffs, as real and imaginary pairs,
+/// at most maxCoeffs of them. Returns the number of coefficients written.
+int sim_fourier(LeafSim* sim, double* coeffs, int maxCoeffs);
+
+/// current simulated time and number of cells
+double sim_time(LeafSim* sim);
+int sim_cells(LeafSim* sim);
+
+/// stop the simulation and free its memory
+void sim_destroy(LeafSim* sim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //FRAP_LEAFSIM_H
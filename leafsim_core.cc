@@ -0,0 +1,162 @@
+/*
+ * leafsim_core: the simulation as a library, with the C interface of leafsim.h
+ * Built headless: nothing here needs GLFW or OpenGL.
+ */
+
+#define REPLICA_LOCAL thread_local   /// every simulation has its own state, on its own thread, see replica.h
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#define DEBUG false
+#define HEADLESS true   /// no window, so no GLFW or OpenGL
+#define MOVING_POINTS true
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "random.h"
+#include "vector.h"
+#include "param.h"
+#include "trace.h"
+#include "transport.h"
+#include "object.h"
+#include "polish.h"
+#include "arrays.h"
+#include "neighbours.h"
+#include "grid.h"
+#include "hormone.h"
+#include "Clarkson-Delaunay.cpp"
+#include "mesh.h"
+#include "springs.h"
+#include "simd.h"
+#include "fitness.h"
+#include "scheduler.h"
+#include "reorder.h"
+#include "domain.h"
+#include "simulation.h"
+#include "leafsim.h"
+
+
+/// a simulation and the thread holding its state, which runs the calls one at a time
+struct LeafSim
+{
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::function<void()> task;   /// call waiting to be run by the thread
+    bool quit = false;
+    StepResult status = STEP_RUNNING;
+
+    LeafSim() : thread(&LeafSim::loop, this) {}
+
+    ~LeafSim(){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        ready.notify_all();
+        thread.join();   /// the thread_local state is freed as the thread exits
+    }
+
+    /// run work on the simulation's thread and wait for it
+    void run(std::function<void()> work){
+        std::unique_lock<std::mutex> lock(mutex);
+        task = work;
+        ready.notify_all();
+        ready.wait(lock, [this]{ return !task; });
+    }
+
+private:
+    void loop(){
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            ready.wait(lock, [this]{ return quit || task; });
+            if (quit) {
+                return;
+            }
+            task();
+            task = nullptr;
+            ready.notify_all();
+        }
+    }
+};
+
+
+LeafSim* sim_create(const char* params){
+    LeafSim* sim = new LeafSim;
+    bool ok = true;
+    sim->run([&](){
+        verbose = false;
+        std::istringstream iss(params ? params : "");
+        std::string token;
+        while (iss >> token) {
+            if (!readOption(token.c_str())) {
+                fprintf(stderr, "leafsim: unknown parameter `%s'\n", token.c_str());
+                ok = false;
+            }
+        }
+#ifdef _OPENMP
+        omp_set_num_threads(1);   /// the OpenMP threads would not see this thread's state
+#endif
+        initSimulation();
+    });
+    if (!ok) {
+        delete sim;
+        return NULL;
+    }
+    return sim;
+}
+
+int sim_step(LeafSim* sim, int n){
+    sim->run([&](){
+        for (int i = 0; (n <= 0 || i < n) && sim->status == STEP_RUNNING; i++) {
+            sim->status = simulationStep();
+        }
+    });
+    return sim->status;
+}
+
+int sim_fourier(LeafSim* sim, double* coeffs, int maxCoeffs){
+    int count = 0;
+    sim->run([&](){
+        count = std::min(numFourierCoeffs(), maxCoeffs);
+        if (count <= 0) {
+            count = 0;
+            return;
+        }
+        double **fourierCoeffs = computeDeltaFourierCoeffs(count);
+        for (int i = 0; i < count; i++){
+            coeffs[2*i] = fourierCoeffs[i][0];
+            coeffs[2*i+1] = fourierCoeffs[i][1];
+            free(fourierCoeffs[i]);
+        }
+        free(fourierCoeffs);
+    });
+    return count;
+}
+
+double sim_time(LeafSim* sim){
+    double time = 0;
+    sim->run([&](){ time = currentTime; });
+    return time;
+}
+
+int sim_cells(LeafSim* sim){
+    int cells = 0;
+    sim->run([&](){ cells = nbo; });
+    return cells;
+}
+
+void sim_destroy(LeafSim* sim){
+    delete sim;
+}
@@ -0,0 +1,244 @@
+//
+// Messages and progress reports, written by a background thread
+//
+
+#ifndef FRAP_LOG_H
+#define FRAP_LOG_H
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <string>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "replica.h"
+
+/// The simulation threads format their messages into the slots of a bounded queue (a lock-free ring buffer,
+/// several producers and one consumer) and carry on; a background thread writes them out. If the queue is
+/// full the message is dropped and counted, the simulation never waits for the terminal.
+/// The progress of the simulation (one line per step before) is printed at most every logPeriod seconds,
+/// and every progressSteps steps a binary record can be added to progressFile (GA/progress.py reads it):
+///   "LSPROG01", then per record: int64 step, double time, double timestep, double wall time (s),
+///   int32 cells, int32 replica.
+/// The settings are read by readOption() like the other parameters.
+
+enum LogLevel
+{
+    LOG_ERROR = 0,
+    LOG_WARNING,
+    LOG_INFO,
+    LOG_PROGRESS,   /// the time and number of cells, rate limited (default)
+    LOG_DEBUG       /// the echo of the .cym file
+};
+
+REPLICA_LOCAL int logLevel = LOG_PROGRESS;     /// messages above this level are not written
+REPLICA_LOCAL double logPeriod = 1;            /// seconds between progress lines, 0 for every step
+REPLICA_LOCAL std::string progressFile = "";   /// binary progress records, none if empty
+REPLICA_LOCAL int progressSteps = 100;         /// steps between progress records
+REPLICA_LOCAL int replicaId = 0;               /// written in the progress records, set by the batch runner
+
+/// one message or progress record
+struct LogSlot
+{
+    std::atomic<size_t> sequence;
+    bool isProgress;
+    int64_t step;
+    int32_t cells, replica;
+    double time, timestep, wall;
+    char text[240];
+};
+
+class Logger
+{
+public:
+    static const size_t CAPACITY = 4096;   /// a power of 2
+
+    Logger(){
+        for (size_t i = 0; i < CAPACITY; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~Logger(){
+        if (writer.joinable()) {
+            stop.store(true);
+            writer.join();
+        }
+        for (auto& file : progress) {
+            if (file.second) fclose(file.second);
+        }
+        if (dropped.load()) {
+            fprintf(stderr, "%zu log messages were dropped\n", dropped.load());
+        }
+    }
+
+    void message(const char* format, va_list args){
+        LogSlot* slot = acquire();
+        if (!slot) return;
+        slot->isProgress = false;
+        vsnprintf(slot->text, sizeof(slot->text), format, args);
+        publish(slot);
+    }
+
+    void record(int64_t step, double time, double timestep, int cells){
+        LogSlot* slot = acquire();
+        if (!slot) return;
+        slot->isProgress = true;
+        slot->step = step;
+        slot->time = time;
+        slot->timestep = timestep;
+        slot->wall = seconds();
+        slot->cells = cells;
+        slot->replica = replicaId;
+        strncpy(slot->text, progressFile.c_str(), sizeof(slot->text) - 1);
+        slot->text[sizeof(slot->text) - 1] = 0;
+        publish(slot);
+    }
+
+    /// wait until everything queued so far is written
+    void flush(){
+        size_t target = enqueuePos.load();
+        while (written.load() < target && writer.joinable()) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        fflush(stdout);
+    }
+
+    double seconds() const{
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    LogSlot slots[CAPACITY];
+    std::atomic<size_t> enqueuePos{0};   /// next slot for the producers
+    size_t dequeuePos = 0;               /// next slot for the writer
+    std::atomic<size_t> written{0};      /// slots handled by the writer, or dropped
+    std::atomic<size_t> dropped{0};
+    std::atomic<bool> stop{false};
+    std::atomic<bool> started{false};
+    std::thread writer;
+    std::map<std::string, FILE*> progress;   /// the replicas of a batch may share a file
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    /// claim the next free slot, or NULL if the queue is full (bounded queue of D. Vyukov)
+    LogSlot* acquire(){
+        startWriter();
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            LogSlot* slot = &slots[pos & (CAPACITY - 1)];
+            size_t seq = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    return slot;
+                }
+            }
+            else if (diff < 0) {
+                dropped++;
+                return NULL;
+            }
+            else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void publish(LogSlot* slot){
+        size_t pos = slot->sequence.load(std::memory_order_relaxed);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+    }
+
+    void startWriter(){
+        if (!started.load(std::memory_order_acquire)) {
+            bool expected = false;
+            if (started.compare_exchange_strong(expected, true)) {
+                writer = std::thread(&Logger::drain, this);
+            }
+        }
+    }
+
+    void drain(){
+        while (true) {
+            LogSlot* slot = &slots[dequeuePos & (CAPACITY - 1)];
+            size_t seq = slot->sequence.load(std::memory_order_acquire);
+            if (seq == dequeuePos + 1) {
+                write(*slot);
+                slot->sequence.store(dequeuePos + CAPACITY, std::memory_order_release);
+                dequeuePos++;
+                written.store(dequeuePos + dropped.load());
+            }
+            else if (stop.load()) {
+                fflush(stdout);
+                return;
+            }
+            else {
+                written.store(dequeuePos + dropped.load());
+                fflush(stdout);
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    void write(const LogSlot& slot){
+        if (!slot.isProgress) {
+            fputs(slot.text, stdout);
+            return;
+        }
+        auto found = progress.find(slot.text);
+        if (found == progress.end()) {
+            FILE* file = fopen(slot.text, "wb");
+            if (!file) {
+                fprintf(stderr, "Error opening file `%s'!\n", slot.text);
+            }
+            else {
+                fwrite("LSPROG01", 1, 8, file);
+            }
+            found = progress.insert(std::make_pair(std::string(slot.text), file)).first;
+        }
+        FILE* file = found->second;
+        if (!file) return;
+        fwrite(&slot.step, sizeof(int64_t), 1, file);
+        fwrite(&slot.time, sizeof(double), 1, file);
+        fwrite(&slot.timestep, sizeof(double), 1, file);
+        fwrite(&slot.wall, sizeof(double), 1, file);
+        fwrite(&slot.cells, sizeof(int32_t), 1, file);
+        fwrite(&slot.replica, sizeof(int32_t), 1, file);
+        fflush(file);   /// so that it can be followed while the simulation runs
+    }
+};
+
+Logger logger;
+
+/// printf to the log, if level is not above logLevel
+void logMessage(int level, const char* format, ...){
+    if (level > logLevel) return;
+    va_list args;
+    va_start(args, format);
+    logger.message(format, args);
+    va_end(args);
+}
+
+REPLICA_LOCAL double lastProgressLine = -1;   /// wall time of the last progress line
+
+/// report the progress after a step: with printLine a line at most every logPeriod seconds (and for the
+/// last step), and a binary record every progressSteps steps
+void logProgress(int64_t step, double time, double timestep, int cells, bool last, bool printLine){
+    if (printLine && LOG_PROGRESS <= logLevel) {
+        double now = logger.seconds();
+        if (last || lastProgressLine < 0 || now - lastProgressLine >= logPeriod) {
+            lastProgressLine = now;
+            logMessage(LOG_PROGRESS, "Step %lld: time = %f, %d cells\n", (long long)step, time, cells);
+        }
+    }
+    if (!progressFile.empty() && (last || (progressSteps > 0 && step % progressSteps == 0))) {
+        logger.record(step, time, timestep, cells);
+    }
+}
+
+void logFlush(){
+    logger.flush();
+}
+
+#endif //FRAP_LOG_H
@@ -0,0 +1,536 @@
+//
+// Incremental Delaunay triangulation kept alive between timesteps
+//
+
+#ifndef FRAP_MESH_H
+#define FRAP_MESH_H
+#include <assert.h>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+/// The points only move a small amount each timestep, so instead of rebuilding the whole convex hull
+/// with Clarkson's code every step, the triangulation is kept and repaired:
+///   - each point is moved to its new position in turn; if its star of triangles stays valid the
+///     edges around it are flipped until they pass the in-circle test (Lawson flips), otherwise it is
+///     removed from the mesh and inserted again at its new position
+///   - daughter cells made in calcMitosis() are inserted into the triangle that contains them
+/// The outside of the hull is covered by "infinite" triangles that share the vertex GHOST, so that
+/// points leaving the hull and hull vertices becoming concave are handled by the same flips.
+/// If the mesh still cannot be repaired we fall back to a full rebuild with BuildTriangleIndexList.
+/// Triangles are stored anticlockwise, neighbour k of a triangle is the one opposite its vertex k.
+/// With meshCheckPeriod=N, every N-th repaired mesh is checked (check()) and rebuilt if it is wrong.
+class TriangleMesh
+{
+public:
+    static constexpr int GHOST = -1;    /// the vertex at infinity
+
+    std::vector<int> triVerts;      /// 3 vertex indices per triangle
+    std::vector<int> triNeigh;      /// 3 neighbouring triangles per triangle
+    std::vector<int> vertTri;       /// one triangle touching each vertex, -1 if the vertex is not meshed
+    std::vector<vector2D> meshPos;  /// positions the mesh is currently valid for
+    std::vector<WORD> indexList;    /// clockwise list of the finite triangles, for the rest of the code
+    std::vector<int> pendingInserts;   /// points added since the last update, waiting to be inserted
+    std::vector<int> pendingHints;     /// a vertex close to each pending point (the mother cell)
+    int numVerts = 0;               /// number of points covered by the mesh
+    bool valid = false;             /// false forces a full rebuild on the next update
+    long numRebuilds = 0;
+    long numFlips = 0;
+    long numReinserts = 0;
+    long numUpdates = 0;
+    long numCheckFailures = 0;
+
+    /// forget the mesh, the next update rebuilds it from scratch
+    void invalidate(){
+        valid = false;
+        pendingInserts.clear();
+        pendingHints.clear();
+    }
+
+    /// the points were moved around in pointsArray, point v being now at newIndex[v]
+    /// newIndex must cover every vertex of the mesh
+    void renumber(const std::vector<int>& newIndex){
+        assert(vertTri.size() <= newIndex.size());
+        for (size_t k = 0; k < triVerts.size(); k++) {
+            if (triVerts[k] != GHOST) triVerts[k] = newIndex[triVerts[k]];
+        }
+        std::vector<int> oldTri(vertTri);
+        std::vector<vector2D> oldPos(meshPos);
+        for (int v = 0; v < (int)oldTri.size(); v++) {
+            vertTri[newIndex[v]] = oldTri[v];
+            meshPos[newIndex[v]] = oldPos[v];
+        }
+        for (size_t i = 0; i < pendingInserts.size(); i++) {
+            pendingInserts[i] = newIndex[pendingInserts[i]];
+            pendingHints[i] = newIndex[pendingHints[i]];
+        }
+    }
+
+    /// register a point that has been appended to pointsArray, hint is a nearby existing point
+    void queueInsert(int vertex, int hint){
+        pendingInserts.push_back(vertex);
+        pendingHints.push_back(hint);
+    }
+
+    /// bring the mesh up to date with the current positions of the first numPoints points
+    void update(int numPoints){
+        int numNew = 0;
+        for (size_t i = 0; i < pendingInserts.size(); i++) {
+            if (pendingInserts[i] >= numVerts) numNew++;
+        }
+        bool ok = valid && (numVerts + numNew == numPoints);
+        for (int v = 0; ok && v < numVerts; v++) {
+            ok = moveVertex(v, pos(v));
+        }
+        for (size_t i = 0; ok && i < pendingInserts.size(); i++) {
+            int p = pendingInserts[i];
+            if (p >= numVerts) {
+                numVerts = p + 1;
+                meshPos.resize(numVerts);
+                vertTri.resize(numVerts, -1);
+            }
+            meshPos[p] = pos(p);
+            ok = insertPoint(p, pendingHints[i]);
+        }
+        pendingInserts.clear();
+        pendingHints.clear();
+        numUpdates++;
+        if (ok && meshCheckPeriod > 0 && numUpdates % meshCheckPeriod == 0 && !check()) {
+            numCheckFailures++;
+            ok = false;
+        }
+        if (!ok) {
+            rebuild(numPoints);
+        }
+        writeIndexList();
+    }
+
+    /// true if the mesh is a Delaunay triangulation of meshPos: every neighbour link goes both ways across
+    /// the same edge, every vertex is in the triangle vertTri points to, the finite triangles are
+    /// anticlockwise and no edge fails the in-circle test (locally Delaunay everywhere is Delaunay)
+    /// The first fault found is logged.
+    bool check() const{
+        for (int t = 0; t < numTris(); t++) {
+            const int* V = &triVerts[3*t];
+            if (V[0] != GHOST && V[1] != GHOST && V[2] != GHOST && orient(V[0], V[1], V[2]) <= 0) {
+                logMessage(LOG_ERROR, "Mesh check: triangle %d (%d %d %d) is not anticlockwise\n", t, V[0], V[1], V[2]);
+                return false;
+            }
+            for (int k = 0; k < 3; k++) {
+                int n = triNeigh[3*t+k];
+                int a = V[(k+1)%3], b = V[(k+2)%3];
+                int j = (n >= 0 && n < numTris()) ? indexOfNeighbour(n, t) : 0;
+                if (n < 0 || n >= numTris() || triNeigh[3*n+j] != t
+                    || triVerts[3*n+(j+1)%3] != b || triVerts[3*n+(j+2)%3] != a) {
+                    logMessage(LOG_ERROR, "Mesh check: triangles %d and %d do not share edge %d-%d both ways\n", t, n, a, b);
+                    return false;
+                }
+                if (inCircle(V[0], V[1], V[2], triVerts[3*n+j])) {
+                    logMessage(LOG_ERROR, "Mesh check: edge %d-%d is not Delaunay\n", a, b);
+                    return false;
+                }
+            }
+        }
+        for (int v = 0; v < numVerts; v++) {
+            int t = vertTri[v];
+            if (t < 0 || t >= numTris() || triVerts[3*t+indexIn(t, v)] != v) {
+                logMessage(LOG_ERROR, "Mesh check: vertex %d is not in its triangle %d\n", v, t);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// rebuild from scratch using Clarkson's triangulation
+    void rebuild(int numPoints){
+        int numListVertices = 0;
+        const int stride = sizeof(vector2D) / sizeof(double);   /// positions are read in place from pointsArray
+        WORD* list = BuildTriangleIndexListStrided(&clarkson, &pos(0).xx, stride, triangulationScale, numPoints, 1, &numListVertices);
+        setFromList(list, numListVertices, numPoints);   /// list belongs to clarkson, which keeps its storage
+        numRebuilds++;
+    }
+
+    /// load a triangle list (any winding), close it with infinite triangles and work out the adjacency
+    void setFromList(const WORD* list, int numListVertices, int numPoints){
+        int numFinite = numListVertices / 3;
+        numVerts = numPoints;
+        valid = (numFinite > 0);
+        meshPos.resize(numPoints);
+        for (int i = 0; i < numPoints; i++) {
+            meshPos[i] = pos(i);
+        }
+        triVerts.assign(list, list + 3*numFinite);
+        for (int t = 0; t < numFinite; t++) {
+            double o = orient(triVerts[3*t], triVerts[3*t+1], triVerts[3*t+2]);
+            if (o < 0) {
+                std::swap(triVerts[3*t+1], triVerts[3*t+2]);
+            }
+            else if (o == 0) {
+                valid = false;  /// flattened by the integer rounding in Clarkson's code, cannot be repaired
+            }
+        }
+
+        /// edges used by a single triangle are on the hull, cover the outside with infinite triangles
+        sortEdges();
+        for (size_t e = 0; e < edges.size(); ) {
+            size_t f = e + 1;
+            while (f < edges.size() && edges[f].first == edges[e].first) f++;
+            if (f - e == 1) {
+                int t = edges[e].second / 3, k = edges[e].second % 3;
+                int a = triVerts[3*t+(k+1)%3], b = triVerts[3*t+(k+2)%3];
+                triVerts.push_back(b);
+                triVerts.push_back(a);
+                triVerts.push_back(GHOST);
+            }
+            e = f;
+        }
+
+        /// now every edge is shared by exactly two triangles
+        triNeigh.assign(triVerts.size(), -1);
+        sortEdges();
+        for (size_t e = 0; e < edges.size(); e += 2) {
+            if (e + 1 >= edges.size() || edges[e].first != edges[e+1].first
+                || (e + 2 < edges.size() && edges[e+2].first == edges[e].first)) {
+                valid = false;  /// not a proper triangulation
+                break;
+            }
+            triNeigh[edges[e].second] = edges[e+1].second / 3;
+            triNeigh[edges[e+1].second] = edges[e].second / 3;
+        }
+
+        vertTri.assign(numPoints, -1);
+        for (size_t t = 0; t < triVerts.size(); t += 3) {
+            for (int k = 0; k < 3; k++) {
+                if (triVerts[t+k] != GHOST) vertTri[triVerts[t+k]] = t / 3;
+            }
+        }
+        /// points dropped by Clarkson's code (e.g. rounded onto another point) are inserted on the next update
+        for (int v = 0; valid && v < numPoints; v++) {
+            if (vertTri[v] == -1) {
+                queueInsert(v, 0);
+            }
+        }
+    }
+
+private:
+    std::vector<int> edgeStack;   /// edges waiting for the in-circle test, stored as 3*triangle+k
+    std::vector<int> star;        /// triangles around the vertex being moved, anticlockwise
+    std::vector<int> hole;        /// polygon left by a removed vertex
+    ClarksonContext clarkson{true};   /// triangulator used by rebuild(), keeps its blocks between rebuilds
+    std::vector<std::pair<uint64_t, int>> edges;
+
+    static const vector2D& pos(int i){
+        return pointsArray[i].disVec;
+    }
+
+    int numTris() const{
+        return triVerts.size() / 3;
+    }
+
+    static uint64_t edgeKey(int a, int b){
+        uint32_t ua = (uint32_t)a, ub = (uint32_t)b;  /// GHOST sorts last
+        if (ua > ub) std::swap(ua, ub);
+        return ((uint64_t)ua << 32) | ub;
+    }
+
+    void sortEdges(){
+        edges.resize(triVerts.size());
+        for (size_t e = 0; e < triVerts.size(); e++) {
+            int t = e / 3, k = e % 3;
+            edges[e] = std::make_pair(edgeKey(triVerts[3*t+(k+1)%3], triVerts[3*t+(k+2)%3]), (int)e);
+        }
+        std::sort(edges.begin(), edges.end());
+    }
+
+    /// twice the signed area of (a, b, c), positive when anticlockwise
+    static double orient(const vector2D& A, const vector2D& B, const vector2D& C){
+        return (B.xx - A.xx) * (C.yy - A.yy) - (B.yy - A.yy) * (C.xx - A.xx);
+    }
+
+    double orient(int a, int b, int c) const{
+        return orient(meshPos[a], meshPos[b], meshPos[c]);
+    }
+
+    /// true if d lies clearly inside the circumcircle of the anticlockwise triangle (a, b, c)
+    /// the circle of an infinite triangle (a, b, GHOST) is the half plane on the left of a->b
+    /// the tolerance stops endless flipping of co-circular points (e.g. a regular lattice)
+    bool inCircle(int a, int b, int c, int d) const{
+        if (d == GHOST) return false;
+        if (a == GHOST) return orient(b, c, d) > 0;
+        if (b == GHOST) return orient(c, a, d) > 0;
+        if (c == GHOST) return orient(a, b, d) > 0;
+        const vector2D& D = meshPos[d];
+        double adx = meshPos[a].xx - D.xx, ady = meshPos[a].yy - D.yy;
+        double bdx = meshPos[b].xx - D.xx, bdy = meshPos[b].yy - D.yy;
+        double cdx = meshPos[c].xx - D.xx, cdy = meshPos[c].yy - D.yy;
+        double alift = adx*adx + ady*ady;
+        double blift = bdx*bdx + bdy*bdy;
+        double clift = cdx*cdx + cdy*cdy;
+        double t1 = alift * (bdx*cdy - cdx*bdy);
+        double t2 = blift * (cdx*ady - adx*cdy);
+        double t3 = clift * (adx*bdy - bdx*ady);
+        double scale = fabs(t1) + fabs(t2) + fabs(t3);
+        return (t1 + t2 + t3) > 1e-10 * scale;
+    }
+
+    int indexIn(int t, int v) const{
+        return (triVerts[3*t] == v) ? 0 : (triVerts[3*t+1] == v) ? 1 : 2;
+    }
+
+    /// fill star with the triangles around v, anticlockwise, each one rotated so that v comes first
+    bool collectStar(int v){
+        star.clear();
+        int t0 = vertTri[v];
+        int t = t0;
+        do {
+            int i = indexIn(t, v);
+            if (triVerts[3*t+i] != v || star.size() > 64) return false;
+            star.push_back(t);
+            t = triNeigh[3*t+(i+1)%3];   /// across the edge (v, triVerts[i+2])
+        } while (t != t0);
+        return true;
+    }
+
+    /// move vertex v to p, keeping the mesh valid and Delaunay
+    bool moveVertex(int v, const vector2D& p){
+        if (vertTri[v] == -1) return true;
+        if (meshPos[v].xx == p.xx && meshPos[v].yy == p.yy) return true;
+        if (!collectStar(v)) return false;
+
+        bool starValid = true;
+        for (size_t s = 0; s < star.size(); s++) {
+            int t = star[s], i = indexIn(t, v);
+            int a = triVerts[3*t+(i+1)%3], b = triVerts[3*t+(i+2)%3];
+            if (a != GHOST && b != GHOST && orient(p, meshPos[a], meshPos[b]) <= 0) {
+                starValid = false;
+            }
+        }
+
+        if (starValid) {
+            meshPos[v] = p;
+            edgeStack.clear();
+            for (size_t s = 0; s < star.size(); s++) {
+                for (int k = 0; k < 3; k++) edgeStack.push_back(3*star[s]+k);
+            }
+            return legalize(edgeStack);
+        }
+        int hint = removeVertex(v);
+        if (hint < 0) return false;
+        meshPos[v] = p;
+        numReinserts++;
+        return insertPoint(v, hint);
+    }
+
+    /// flip every edge on the stack (and the edges uncovered by each flip) until all pass the in-circle test
+    bool legalize(std::vector<int>& stack){
+        long maxFlips = 16 * (long)triVerts.size() + 1024;   /// guards against cycling on degenerate input
+        while (!stack.empty()) {
+            int e = stack.back();
+            stack.pop_back();
+            int t = e / 3, k = e % 3;
+            int u = triNeigh[e];
+            int m = 0;
+            while (m < 3 && triNeigh[3*u+m] != t) m++;
+            if (m == 3) return false;
+            int a = triVerts[3*t+k], b = triVerts[3*t+(k+1)%3], c = triVerts[3*t+(k+2)%3];
+            int d = triVerts[3*u+m];
+            if (!inCircle(a, b, c, d)) continue;
+            if (--maxFlips < 0) return false;
+
+            int nAB = triNeigh[3*t+(k+2)%3], nCA = triNeigh[3*t+(k+1)%3];
+            int nBD = triNeigh[3*u+(m+1)%3], nDC = triNeigh[3*u+(m+2)%3];
+            setTriangle(t, a, b, d, nBD, u, nAB);
+            setTriangle(u, a, d, c, nDC, nCA, t);
+            replaceNeighbour(nBD, u, t);
+            replaceNeighbour(nCA, t, u);
+            setVertTri(a, t); setVertTri(b, t);
+            setVertTri(c, u); setVertTri(d, u);
+            numFlips++;
+
+            stack.push_back(3*t+0);   /// edge (b, d)
+            stack.push_back(3*t+2);   /// edge (a, b)
+            stack.push_back(3*u+0);   /// edge (d, c)
+            stack.push_back(3*u+1);   /// edge (c, a)
+        }
+        return true;
+    }
+
+    void setTriangle(int t, int a, int b, int c, int nA, int nB, int nC){
+        triVerts[3*t] = a; triVerts[3*t+1] = b; triVerts[3*t+2] = c;
+        triNeigh[3*t] = nA; triNeigh[3*t+1] = nB; triNeigh[3*t+2] = nC;
+    }
+
+    void setVertTri(int v, int t){
+        if (v != GHOST) vertTri[v] = t;
+    }
+
+    void replaceNeighbour(int t, int from, int to){
+        for (int k = 0; k < 3; k++) {
+            if (triNeigh[3*t+k] == from) {
+                triNeigh[3*t+k] = to;
+                return;
+            }
+        }
+    }
+
+    /// walk from the triangle at the hint towards p
+    /// returns -1 if p sits on an edge, where splitting would make a flat triangle
+    int locate(int p, int hint) const{
+        const vector2D& P = meshPos[p];
+        int t = (hint >= 0 && hint < numVerts && vertTri[hint] != -1) ? vertTri[hint] : 0;
+        long maxSteps = (long)numTris() + 16;
+        for (int start = 0; maxSteps-- > 0; start++) {
+            int g = indexIn(t, GHOST);
+            if (triVerts[3*t+g] == GHOST) {
+                /// infinite triangle: p is in it if it is outside the hull edge
+                double o = orient(meshPos[triVerts[3*t+(g+1)%3]], meshPos[triVerts[3*t+(g+2)%3]], P);
+                if (o > 0) return t;
+                t = triNeigh[3*t+g];
+                continue;
+            }
+            int next = -2;
+            for (int j = 0; j < 3; j++) {
+                int k = (start + j) % 3;   /// rotate the first edge tested so the walk cannot cycle
+                double o = orient(meshPos[triVerts[3*t+(k+1)%3]], meshPos[triVerts[3*t+(k+2)%3]], P);
+                if (o < 0) {
+                    next = triNeigh[3*t+k];
+                    break;
+                }
+                if (o == 0) {
+                    next = -1;
+                }
+            }
+            if (next == -2) return t;
+            if (next == -1) return -1;
+            t = next;
+        }
+        return -1;
+    }
+
+    /// split the triangle containing p into three and restore the Delaunay property around it
+    bool insertPoint(int p, int hint){
+        int t = locate(p, hint);
+        if (t == -1) return false;
+
+        int a = triVerts[3*t], b = triVerts[3*t+1], c = triVerts[3*t+2];
+        int nA = triNeigh[3*t], nB = triNeigh[3*t+1], nC = triNeigh[3*t+2];
+        int t1 = numTris(), t2 = t1 + 1;
+        triVerts.resize(triVerts.size() + 6);
+        triNeigh.resize(triNeigh.size() + 6);
+        setTriangle(t,  p, b, c, nA, t1, t2);
+        setTriangle(t1, p, c, a, nB, t2, t);
+        setTriangle(t2, p, a, b, nC, t, t1);
+        replaceNeighbour(nB, t, t1);
+        replaceNeighbour(nC, t, t2);
+        setVertTri(p, t); setVertTri(b, t); setVertTri(c, t); setVertTri(a, t1);
+
+        edgeStack.clear();
+        edgeStack.push_back(3*t);
+        edgeStack.push_back(3*t1);
+        edgeStack.push_back(3*t2);
+        return legalize(edgeStack);
+    }
+
+    /// take a vertex out of the mesh by re-triangulating the hole it leaves with Delaunay ears
+    /// for a hull vertex the hole contains GHOST, its ears are the edges of the new hull
+    /// returns a vertex of the hole to start looking from when the vertex is inserted again, or -1
+    int removeVertex(int v){
+        /// the hole polygon, each edge remembers the triangle slot on its far side
+        int k = star.size();
+        hole.resize(3*k);
+        for (int s = 0; s < k; s++) {
+            int t = star[s], i = indexIn(t, v);
+            int outer = triNeigh[3*t+i];
+            hole[3*s] = triVerts[3*t+(i+1)%3];
+            hole[3*s+1] = outer;
+            hole[3*s+2] = 3*outer + indexOfNeighbour(outer, t);
+        }
+
+        /// the ears go into the lowest slots of the star, the two left over are freed
+        std::sort(star.begin(), star.end());
+        int slot = 0;
+        while (k > 3) {
+            int best = -1;
+            for (int i = 0; i < k && best < 0; i++) {
+                int a = hole[3*((i+k-1)%k)], b = hole[3*i], c = hole[3*((i+1)%k)];
+                bool finite = (a != GHOST && b != GHOST && c != GHOST);
+                if (finite && orient(a, b, c) <= 0) continue;
+                bool empty = true;
+                for (int j = 0; j < k && empty; j++) {
+                    int d = hole[3*j];
+                    if (d != a && d != b && d != c && inCircle(a, b, c, d)) empty = false;
+                }
+                if (empty) best = i;
+            }
+            if (best < 0) return -1;
+            int ip = (best+k-1)%k;
+            int t = star[slot++];
+            earTriangle(t, hole[3*ip], hole[3*best], hole[3*((best+1)%k)], &hole[3*best], &hole[3*ip]);
+            hole[3*ip+1] = t;
+            hole[3*ip+2] = 3*t + 1;
+            hole.erase(hole.begin() + 3*best, hole.begin() + 3*best + 3);
+            k--;
+        }
+        int t = star[slot++];
+        earTriangle(t, hole[0], hole[3], hole[6], &hole[3], &hole[0]);
+        triNeigh[3*t+1] = hole[7];
+        triNeigh[hole[8]] = t;
+
+        vertTri[v] = -1;
+        int hint = (hole[0] != GHOST) ? hole[0] : hole[3];
+        std::vector<int> spare(star.begin() + slot, star.end());
+        std::sort(spare.rbegin(), spare.rend());
+        for (size_t s = 0; s < spare.size(); s++) {
+            deleteTriangle(spare[s]);
+        }
+
+        /// the hull may have become concave where the vertex was taken out
+        edgeStack.clear();
+        for (size_t t = 0; t < star.size() - spare.size(); t++) {
+            for (int j = 0; j < 3; j++) edgeStack.push_back(3*star[t]+j);
+        }
+        return legalize(edgeStack) ? hint : -1;
+    }
+
+    int indexOfNeighbour(int t, int n) const{
+        return (triNeigh[3*t] == n) ? 0 : (triNeigh[3*t+1] == n) ? 1 : 2;
+    }
+
+    /// make the ear (a, b, c) in slot t, bc and ab are the hole edges it closes off
+    void earTriangle(int t, int a, int b, int c, const int* edgeBC, const int* edgeAB){
+        setTriangle(t, a, b, c, edgeBC[1], -1, edgeAB[1]);
+        triNeigh[edgeBC[2]] = t;
+        triNeigh[edgeAB[2]] = t;
+        setVertTri(a, t); setVertTri(b, t); setVertTri(c, t);
+    }
+
+    /// free slot t by moving the last triangle into it, nothing may point at t anymore
+    void deleteTriangle(int t){
+        int last = numTris() - 1;
+        if (t != last) {
+            for (int k = 0; k < 3; k++) {
+                triVerts[3*t+k] = triVerts[3*last+k];
+                triNeigh[3*t+k] = triNeigh[3*last+k];
+                replaceNeighbour(triNeigh[3*t+k], last, t);
+                setVertTri(triVerts[3*t+k], t);
+            }
+        }
+        triVerts.resize(3*last);
+        triNeigh.resize(3*last);
+    }
+
+    /// copy the finite triangles out in clockwise order, matching what BuildTriangleIndexList produced
+    void writeIndexList(){
+        indexList.clear();
+        for (size_t t = 0; t < triVerts.size(); t += 3) {
+            if (triVerts[t] == GHOST || triVerts[t+1] == GHOST || triVerts[t+2] == GHOST) continue;
+            indexList.push_back((WORD)triVerts[t]);
+            indexList.push_back((WORD)triVerts[t+2]);
+            indexList.push_back((WORD)triVerts[t+1]);
+        }
+    }
+};
+
+REPLICA_LOCAL TriangleMesh leafMesh;   /// the triangulation of pointsArray, kept between timesteps
+
+#endif //FRAP_MESH_H
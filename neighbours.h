@@ -0,0 +1,139 @@
+//
+// Neighbour graph of the points, built from the delaunay triangle list
+//
+
+#ifndef FRAP_NEIGHBOURS_H
+#define FRAP_NEIGHBOURS_H
+#include <vector>
+
+/// Compressed sparse row adjacency: the neighbours of point i are
+/// indices[offsets[i]] ... indices[offsets[i+1]-1], each listed once, in the order they first
+/// appear in the triangle list. The vectors keep their capacity, so after the first few
+/// timesteps rebuilding the graph does not allocate.
+class NeighbourGraph
+{
+public:
+    std::vector<int> offsets;   /// numPoints + 1 entries, start of each row in indices
+    std::vector<int> indices;   /// the neighbours of every point, row after row
+    int numPoints = 0;
+
+    int begin(int i) const{ return offsets[i]; }
+    int end(int i) const{ return offsets[i+1]; }
+    int degree(int i) const{ return offsets[i+1] - offsets[i]; }
+
+    /// fill the graph from a list of triangles (numVertices indices, 3 per triangle)
+    void build(const WORD* triangles, int numVertices, int numPts){
+        TRACE_SCOPE("neighbour graph");
+        numPoints = numPts;
+        offsets.assign(numPoints + 1, 0);
+        fill.resize(numPoints);
+        lastSeen.assign(numPoints, -1);
+
+        /// each triangle gives two (possibly repeated) neighbours to each of its vertices
+        for (int v = 0; v < numVertices; v++) {
+            offsets[triangles[v] + 1] += 2;
+        }
+        for (int i = 0; i < numPoints; i++) {
+            offsets[i+1] += offsets[i];
+            fill[i] = offsets[i];
+        }
+        indices.resize(offsets[numPoints]);
+        for (int v = 0; v < numVertices; v += 3) {
+            int a = triangles[v], b = triangles[v+1], c = triangles[v+2];
+            indices[fill[a]++] = b;
+            indices[fill[a]++] = c;
+            indices[fill[b]++] = a;
+            indices[fill[b]++] = c;
+            indices[fill[c]++] = a;
+            indices[fill[c]++] = b;
+        }
+
+        /// remove the duplicates (every interior edge is shared by two triangles) and close the gaps
+        int out = 0;
+        for (int i = 0; i < numPoints; i++) {
+            int start = offsets[i];
+            offsets[i] = out;
+            for (int l = start; l < fill[i]; l++) {
+                int n = indices[l];
+                if (lastSeen[n] != i) {
+                    lastSeen[n] = i;
+                    indices[out++] = n;
+                }
+            }
+        }
+        offsets[numPoints] = out;
+        indices.resize(out);
+
+#if DEBUG
+        printf("Neighbour graph: \n");
+        for (int i = 0; i < numPoints; i++){
+            printf("nbo %d:  ", i);
+            for (int l = begin(i); l < end(i); l++){
+                printf(" %d", indices[l]);
+            }
+            printf("\n");
+        }
+        printf("\n\n");
+#endif
+    }
+
+private:
+    std::vector<int> fill;       /// write position in each row while building
+    std::vector<int> lastSeen;   /// last row each point was added to, for removing duplicates
+};
+
+REPLICA_LOCAL NeighbourGraph neighbourGraph;   /// neighbours of pointsArray, rebuilt after each triangulation
+
+
+/// Every undirected edge of the graph once, as the pair (first[e], second[e]) with first < second.
+/// Edges are ordered by their first point, so walking the list touches pointsArray roughly in order.
+/// The edges touching each point are also kept (incident, in CSR form, in increasing edge order), so that
+/// a quantity computed once per edge can be summed up by each point on its own, without write conflicts.
+class EdgeList
+{
+public:
+    std::vector<int> first;
+    std::vector<int> second;
+    std::vector<int> incidentOffsets;   /// numPoints + 1 entries, start of each point's edges in incident
+    std::vector<int> incident;          /// the edges of every point, point after point
+
+    int size() const{ return first.size(); }
+
+    void build(const NeighbourGraph& graph){
+        TRACE_SCOPE("edge list");
+        first.clear();
+        second.clear();
+        for (int i = 0; i < graph.numPoints; i++) {
+            for (int l = graph.begin(i); l < graph.end(i); l++) {
+                if (graph.indices[l] > i) {
+                    first.push_back(i);
+                    second.push_back(graph.indices[l]);
+                }
+            }
+        }
+
+        int numPoints = graph.numPoints;
+        incidentOffsets.assign(numPoints + 1, 0);
+        for (int e = 0; e < size(); e++) {
+            incidentOffsets[first[e] + 1]++;
+            incidentOffsets[second[e] + 1]++;
+        }
+        cursor.resize(numPoints);
+        for (int i = 0; i < numPoints; i++) {
+            incidentOffsets[i+1] += incidentOffsets[i];
+            cursor[i] = incidentOffsets[i];
+        }
+        incident.resize(incidentOffsets[numPoints]);
+        for (int e = 0; e < size(); e++) {
+            incident[cursor[first[e]]++] = e;
+            incident[cursor[second[e]]++] = e;
+        }
+    }
+
+private:
+    std::vector<int> cursor;   /// write position for each point while building
+};
+
+REPLICA_LOCAL EdgeList edgeList;   /// edges of neighbourGraph, rebuilt with it
+
+#endif //FRAP_NEIGHBOURS_H
@@ -4,56 +4,127 @@ Points contain hooks constants which are used to simulate spring-like physics
 This file contains information about Object which contains
  */
 #include <math.h>
+#include <vector>
+#include <numeric>
 #include "sigmoid.h"
 /// for the compiler this doesn't slow down the programme
 
-class Point
+/// Cells are stored as a structure of arrays: each attribute is one contiguous array over all the cells,
+/// so a loop that only needs positions and radii (springs, diffusion) only pulls those through the cache.
+/// The hooks constants are the same for every cell and are kept once for the whole store.
+class Point;
+
+class CellStore
 {
-public:  /// these are attributes that can be called outside of the script
-    /// member variables:
-    vector2D disVec = vector2D(double (0.05*xBound*mySrand()), double (0.05*yBound*mySrand())); /// sets x and y values randomly
-    vector2D velVec = vector2D(0.0001, 0.0001); /// initial velocities set to very small, prevents bugs
-    vector2D springVec = vector2D(0, 0);  /// would be set (0, 0) by default but just in case
-    vector2D mitosisOrient = vector2D(1, 1);
+public:
+    std::vector<vector2D> disVec;       /// positions
+    std::vector<vector2D> springVec;    /// spring forces from the neighbours
+    std::vector<double> cellRadiusBase, cellRadius;
+
+    /// hormone amounts and their changes over the current timestep
+    std::vector<double> myTotalHormone1, myDeltaHormone1;
+    std::vector<double> myTotalHormone2, myDeltaHormone2;
+    std::vector<char> isHormone1Producer, isHormone2Producer;  /// char, as std::vector<bool> cannot hand out references
+    std::vector<int> cellId;            /// follows a cell when the cells are reordered (reorder.h), for output and random streams
+    int nextId;                         /// the id of the next daughter
 
     double extendedHooks, compressedHooks, innerMultiplier, innerCompressedHooks;  /// hooks constant for attracting points back to the centre
-    double cellRadiusBase, cellRadius;
-    double cellMass;
-    double probOfDividing;
     int color;
 
-    /// members related to hormone function
-    bool isHormone1Producer = false;
-    double myTotalHormone1 = 0;
-    double myDeltaHormone1 = 0; /// keeps track of amount of hormone gained/lost
-    double myRateOfProd1 = 0;
-    double myRateOfDeg1 = 0;
-    double myExpandEffect = 0;
-    double myHormoneSensitivity = 0;
-
-    bool isHormone2Producer = false;
-    double myTotalHormone2 = 0;
-    double myDeltaHormone2 = 0;
-    double myRateOfProd2 = 0;
-
-    /// members related to cell division
-
-    /// initialize each point in a random position with random x and y velocities
-    void reset()
+    /// allocate room for size cells, each in a random position
+    explicit CellStore(size_t size) : disVec(size), springVec(size), cellRadiusBase(size), cellRadius(size),
+                                      myTotalHormone1(size, 0), myDeltaHormone1(size, 0),
+                                      myTotalHormone2(size, 0), myDeltaHormone2(size, 0),
+                                      isHormone1Producer(size, false), isHormone2Producer(size, false),
+                                      cellId(size)
     {
         extendedHooks = 0.02;
         compressedHooks = 0.2;
         innerMultiplier = 10;
         innerCompressedHooks = innerMultiplier * compressedHooks;
-        cellRadiusBase = 0.012 * SCALING_FACTOR; /// in micrometers
-        cellRadius = cellRadiusBase;
-        cellMass = 1; /// in nanograms
         color = 1;
+        resetIds(0);
+        placeRandomly();
+    }
+
+    /// each slot gets its own index as id, daughters continue from numCells
+    void resetIds(int numCells){
+        std::iota(cellId.begin(), cellId.end(), 0);
+        nextId = numCells;
+    }
+
+    /// give every cell a random position near the centre and the base radius
+    /// called again once the parameters are read, after the random generator is seeded
+    void placeRandomly(){
+        for (size_t i = 0; i < disVec.size(); i++) {
+            if (randomStreams) {
+                RandomStream random(seed, RANDOM_PLACEMENT, 0, cellId[i]);
+                double x = random.srand();
+                disVec[i] = vector2D(0.05*xBound*x, 0.05*yBound*random.srand());
+            }
+            else {
+                disVec[i] = vector2D(double (0.05*xBound*mySrand()), double (0.05*yBound*mySrand())); /// sets x and y values randomly
+            }
+            cellRadiusBase[i] = 0.012 * SCALING_FACTOR; /// in micrometers
+            cellRadius[i] = cellRadiusBase[i];
+        }
     }
-    
-    /// call initialize
-    Point(){
-        reset();
+
+    /// slots begin..end-1 as they were before any cell used them, which is what a daughter starts from
+    void clearCells(int begin, int end){
+        for (int i = begin; i < end; i++) {
+            springVec[i].setZeros();
+            cellRadiusBase[i] = 0.012 * SCALING_FACTOR;   /// as placeRandomly()
+            cellRadius[i] = cellRadiusBase[i];
+            myTotalHormone1[i] = 0;
+            myDeltaHormone1[i] = 0;
+            myTotalHormone2[i] = 0;
+            myDeltaHormone2[i] = 0;
+            isHormone1Producer[i] = false;
+            isHormone2Producer[i] = false;
+        }
+    }
+
+    /// a handle on cell i, used like the old Point objects
+    inline Point operator[](int i);
+};
+
+
+/// handle on one cell of a CellStore, its members are references into the store's arrays
+/// copy it (Point p = pointsArray[i]) rather than binding a reference to it
+class Point
+{
+public:  /// these are attributes that can be called outside of the script
+    /// member variables:
+    vector2D& disVec;
+    vector2D& springVec;
+
+    const double& extendedHooks;
+    const double& compressedHooks;
+    const double& innerCompressedHooks;
+    double& cellRadiusBase;
+    double& cellRadius;
+    const int& color;
+
+    /// members related to hormone function
+    char& isHormone1Producer;
+    double& myTotalHormone1;
+    double& myDeltaHormone1; /// keeps track of amount of hormone gained/lost
+
+    char& isHormone2Producer;
+    double& myTotalHormone2;
+    double& myDeltaHormone2;
+
+    Point(CellStore& store, int i) : disVec(store.disVec[i]), springVec(store.springVec[i]),
+                                     extendedHooks(store.extendedHooks), compressedHooks(store.compressedHooks),
+                                     innerCompressedHooks(store.innerCompressedHooks),
+                                     cellRadiusBase(store.cellRadiusBase[i]), cellRadius(store.cellRadius[i]),
+                                     color(store.color),
+                                     isHormone1Producer(store.isHormone1Producer[i]),
+                                     myTotalHormone1(store.myTotalHormone1[i]), myDeltaHormone1(store.myDeltaHormone1[i]),
+                                     isHormone2Producer(store.isHormone2Producer[i]),
+                                     myTotalHormone2(store.myTotalHormone2[i]), myDeltaHormone2(store.myDeltaHormone2[i])
+    {
     }
 
 
@@ -65,6 +136,7 @@ public:  /// these are attributes that can be called outside of the script
         disVec += (timestep/(mobilityCoefficient * cellRadius/SCALING_FACTOR)) * springVec;
     }
 
+#if !HEADLESS
     /// partial display: this needs to be called between glBegin() and glEnd()
     void displayYellow(){
         /// transparency used to visualize overlapping particles
@@ -92,15 +164,14 @@ public:  /// these are attributes that can be called outside of the script
             glColor4f(0, 1, 0, 1);
         glVertex2f(disVec.xx, disVec.yy);
     }
+#endif
 /// BD here represents Birth-death process, need new functions for reaction-diffusion
     void produceHormone1BD(double inputProdRate){
-        myRateOfProd1 = inputProdRate;
-        myDeltaHormone1 += myRateOfProd1;
+        myDeltaHormone1 += inputProdRate;
     }
 
     void degradeHormone1BD(double inputDegRate){
-        myRateOfDeg1 = inputDegRate;
-        myDeltaHormone1 += myRateOfDeg1*myTotalHormone1;
+        myDeltaHormone1 += inputDegRate*myTotalHormone1;
     }
 
     void produceHormone1ReactD(double inputFeedRate){
@@ -139,6 +210,7 @@ public:  /// these are attributes that can be called outside of the script
         }
     }
 
+#if !HEADLESS
     void sigmoidDisplayHormone() {
         double sigmoidHormConc = sigmoid((12*myTotalHormone1)-5); /// this shifts curve so that color scales from 0 to 1
         glColor4f((sigmoidHormConc), 0, (1 - sigmoidHormConc), 1);
@@ -156,6 +228,7 @@ public:  /// these are attributes that can be called outside of the script
         glColor4f((linearHormConc), (0.5 - 0.5*linearHormConc), (1 - linearHormConc), 1);
         glVertex2f(disVec.xx, disVec.yy);
     }
+#endif
 
 
     double divisionProb(double maxProbOfDiv, int numCurrentCells, int finalTotCells) { /// each cell has a p(mitosis) varied by number of existing points, cell size etc.
@@ -163,3 +236,7 @@ public:  /// these are attributes that can be called outside of the script
         return divisionProb;
     }
 };
+
+Point CellStore::operator[](int i){
+    return Point(*this, i);
+}
@@ -6,75 +6,107 @@
 #include <cmath>
 #include <sstream>
 #include <fstream>
+#include <string>
+#include <vector>
+#include "replica.h"
+#include "log.h"
 
 const double SCALING_FACTOR = 100000;
 
 // physical parameters:  ensure to add any new parameters to the readOption() function
-double xBound = 1 * SCALING_FACTOR;   /// half-width of box (X) in micrometers
-double yBound = xBound;   /// half-height of box (Y), is set to be equal to y for saftey
-double pixel = 1;    /// size of one pixel in GL units
+REPLICA_LOCAL double xBound = 1 * SCALING_FACTOR;   /// half-width of box (X) in micrometers
+REPLICA_LOCAL double yBound = xBound;   /// half-height of box (Y), is set to be equal to y for saftey
+REPLICA_LOCAL double pixel = 1;    /// size of one pixel in GL units
+REPLICA_LOCAL double triangulationScale = 1;   /// Clarkson's code works on integers: positions are rounded to multiples of 1/triangulationScale
+REPLICA_LOCAL int meshCheckPeriod = 0;   /// check the repaired mesh every so many updates, 0 for never (see TriangleMesh::check)
 
 
-int nbo = 20;    /// initial number of objects (points)
+REPLICA_LOCAL int nbo = 20;    /// initial number of objects (points)
 
 // spring-physics parameters
 const double fluidViscosity = 0.0016; /// Pa.s, velocity of water at 20 degrees celcius
 const double mobilityCoefficient = 6 * 3.14159 * fluidViscosity;
 const double breakSpringCoeff = 1.2;
+REPLICA_LOCAL bool useSimd = true;  /// use the AVX2/AVX-512 spring kernel when the CPU has it
+REPLICA_LOCAL int threads = 1;      /// threads sharing the force and hormone loops (needs OpenMP)
+REPLICA_LOCAL bool useContactGrid = false;  /// find the springs with a uniform grid (grid.h) instead of the delaunay triangulation
 
 // timestep parameters
-double timestep = 0.00004; /// viscosity is in Pa.sec so this is seconds. 60 fps means 1sec simulated = 1.8sec realtime
-int delay = 16;         /// milli-seconds between successive display
-double delta = 0.00001;
-unsigned long seed = 2; /// seed for random number generator
-double finalTime = 1;
-double realTime = 0;     /// time in the simulated world
-int finalIterationNumber = 100;  /// iterations before final frame
-int maxFourierCoeffs = 15;
+REPLICA_LOCAL double timestep = 0.00004; /// viscosity is in Pa.sec so this is seconds. 60 fps means 1sec simulated = 1.8sec realtime
+const double referenceTimestep = 0.00004;  /// the default step, which the rates per step (division, diffusion) were tuned with
+REPLICA_LOCAL bool adaptiveTimestep = false;  /// choose the timestep each step from the forces and the hormone changes
+REPLICA_LOCAL double timestepMin = 0.000004;
+REPLICA_LOCAL double timestepMax = 0.004;
+REPLICA_LOCAL double displacementTolerance = 0.1;   /// largest move of a cell in one step, as a fraction of its radius
+REPLICA_LOCAL double hormoneTolerance = 0.05;       /// largest change of a hormone amount in one step, as a fraction of the largest amount
+REPLICA_LOCAL int mechSubsteps = 1;   /// spring substeps per timestep, all on the neighbours found at the start of the step
+REPLICA_LOCAL int chemSubsteps = 1;   /// hormone substeps per timestep, on the same neighbours and the positions after the springs
+REPLICA_LOCAL int delay = 16;         /// milli-seconds between successive display
+REPLICA_LOCAL double delta = 0.00001;
+REPLICA_LOCAL unsigned long seed = 1; /// seed for the random number generator, 1 gives the sequence rand() had by default
+REPLICA_LOCAL bool randomStreams = true;  /// a random stream per cell and step (see random.h), 0 for the sequence of rand()
+REPLICA_LOCAL std::string cellsFile = "";  /// the final state of every cell, by cellId, if not empty
+REPLICA_LOCAL int reorderPeriod = 0;  /// steps between sorting the cells along a Hilbert curve (reorder.h), 0 for never
+REPLICA_LOCAL double haloWidth = 2;   /// leafsim_domain: cells copied from the neighbouring ranks, in spring reaches (domain.h)
+REPLICA_LOCAL int rebalancePeriod = 100;   /// leafsim_domain: steps between checks of the balance of the ranks
+REPLICA_LOCAL double rebalanceImbalance = 1.2;   /// leafsim_domain: the slabs are cut again above this ratio of the largest to the mean number of cells
+REPLICA_LOCAL bool scheduleDivisions = true;  /// draw the time of the next division of each cell (scheduler.h), 0 for a trial per step
+REPLICA_LOCAL double finalTime = 1;
+REPLICA_LOCAL double realTime = 0;     /// time in the simulated world
+REPLICA_LOCAL int finalIterationNumber = 100;  /// iterations before final frame
+REPLICA_LOCAL int maxFourierCoeffs = 15;
+REPLICA_LOCAL bool verbose = true;   /// echo the parameters and print the progress (see log.h)
+REPLICA_LOCAL std::string traceFile = "trace.json";   /// .json for a Chrome trace, binary otherwise (built with TRACE only)
+REPLICA_LOCAL int traceCapacity = 1 << 20;   /// events kept by the trace ring buffer
+REPLICA_LOCAL bool display = false;  /// open a window and draw the cells, not in the headless build
+REPLICA_LOCAL std::string checkpointFile = "checkpoint.bin";   /// written every checkpointPeriod, see checkpoint.h
+REPLICA_LOCAL double checkpointPeriod = 0;   /// seconds (wall clock) between checkpoints, 0 for none
+REPLICA_LOCAL std::vector<std::string> optionsRead;   /// every option read so far, saved in checkpoints
 
 // hormone parameters
 
-double hormone1ProdRate = 100;
-double hormone1DegRate = 10; /// not used if reaction-diffusion used
-double hormone1IntroTime = 0.00360;
-vector2D hormone1OriginV1 = vector2D(0.1 * xBound, 0.1 * xBound);
-double inputHorm1DiffCoeff = 160;
-double hormone1DiffCoeff = inputHorm1DiffCoeff * SCALING_FACTOR;
-double horm1Efficacy = 5;
-double horm1DivOrientVertComp = 5;
-double horm1DivOrientHoriComp = 0;
-vector2D horm1DivOrient = vector2D(horm1DivOrientHoriComp, horm1DivOrientVertComp);
-
-
-double hormone2ProdRate = 33;
-double hormone2DegRate = 666;
-double horm1toHorm2Ratio = 0.9375;
-double hormone2DiffCoeff =
+REPLICA_LOCAL double hormone1ProdRate = 100;
+REPLICA_LOCAL double hormone1DegRate = 10; /// not used if reaction-diffusion used
+REPLICA_LOCAL double hormone1IntroTime = 0.00360;
+REPLICA_LOCAL vector2D hormone1OriginV1 = vector2D(0.1 * xBound, 0.1 * xBound);
+REPLICA_LOCAL double inputHorm1DiffCoeff = 160;
+REPLICA_LOCAL double hormone1DiffCoeff = inputHorm1DiffCoeff * SCALING_FACTOR;
+REPLICA_LOCAL double horm1Efficacy = 5;
+REPLICA_LOCAL double horm1DivOrientVertComp = 5;
+REPLICA_LOCAL double horm1DivOrientHoriComp = 0;
+REPLICA_LOCAL vector2D horm1DivOrient = vector2D(horm1DivOrientHoriComp, horm1DivOrientVertComp);
+
+
+REPLICA_LOCAL double hormone2ProdRate = 33;
+REPLICA_LOCAL double hormone2DegRate = 666;
+REPLICA_LOCAL double horm1toHorm2Ratio = 0.9375;
+REPLICA_LOCAL double hormone2DiffCoeff =
         horm1toHorm2Ratio * hormone1DiffCoeff; /// in the gray-scott model the rate of diff of horm2 is twice 1
-double horm2Efficacy = 10;
-double hormone2IntroTime = 0.00360;
-double horm2SourceHor = 0.2;
-double horm2SourceVer = 0;
-vector2D horm2Source1 = vector2D(horm2SourceHor, horm2SourceVer);
-double horm2DivOrientVertComp = 0;
-double horm2DivOrientHoriComp = 5;
-vector2D horm2DivOrient = vector2D(horm2DivOrientHoriComp, horm2DivOrientVertComp);
-
-double RDfeedRate = 35;
-double RDfeedToKillRatio = 1.14;
-double RDkillRate = RDfeedRate * RDfeedToKillRatio;
-double reactRate1to2 = 6400;
-double lengthOfHorm2Prod = 1;
+REPLICA_LOCAL double horm2Efficacy = 10;
+REPLICA_LOCAL double hormone2IntroTime = 0.00360;
+REPLICA_LOCAL double horm2SourceHor = 0.2;
+REPLICA_LOCAL double horm2SourceVer = 0;
+REPLICA_LOCAL vector2D horm2Source1 = vector2D(horm2SourceHor, horm2SourceVer);
+REPLICA_LOCAL double horm2DivOrientVertComp = 0;
+REPLICA_LOCAL double horm2DivOrientHoriComp = 5;
+REPLICA_LOCAL vector2D horm2DivOrient = vector2D(horm2DivOrientHoriComp, horm2DivOrientVertComp);
+
+REPLICA_LOCAL double RDfeedRate = 35;
+REPLICA_LOCAL double RDfeedToKillRatio = 1.14;
+REPLICA_LOCAL double RDkillRate = RDfeedRate * RDfeedToKillRatio;
+REPLICA_LOCAL double reactRate1to2 = 6400;
+REPLICA_LOCAL double lengthOfHorm2Prod = 1;
+REPLICA_LOCAL int hormoneSolver = 0;   /// 0: explicit Euler, 1: IMEX (implicit reactions per cell and implicit diffusion, see HormoneIMEX)
 
 
 // mitosis parameters
-double baseMaxProbOfDiv = 0.0005; /// should inform this with the maximal amount of cell division that can occur, dont think this should be tunable
-double DesiredTotalCells = 1000; /// used to calculate mitosis probabilites
+REPLICA_LOCAL double baseMaxProbOfDiv = 0.0005; /// should inform this with the maximal amount of cell division that can occur, dont think this should be tunable
+REPLICA_LOCAL double DesiredTotalCells = 1000; /// used to calculate mitosis probabilites
 
 
 
 
-bool displayInverseFourier = true;
+REPLICA_LOCAL bool displayInverseFourier = true;
 
 
 //-----------------------------------------------------------------------------
@@ -90,9 +122,23 @@ int readParameter(const char arg[], const char name[], T & ptr)
     return 0;
 }
 
-int readOption(const char arg[])
+/// as readParameter() for a number of substeps, which must be at least 1: a smaller value is rejected
+/// with an error, and the parameter keeps its value
+int readCount(const char arg[], const char name[], int & count)
+{
+    int value;
+    if ( !readParameter(arg, name, value) )
+        return 0;
+    if ( value < 1 ) {
+        logMessage(LOG_ERROR, "`%s': the number of substeps must be at least 1, keeping %s%d\n", arg, name, count);
+        return 1;
+    }
+    count = value;
+    return 1;
+}
+
+int parseOption(const char arg[])
 {
-    printf("[%s]\n", arg);
     if ( readParameter(arg, "n=",     nbo) )    return 1;
     if ( readParameter(arg, "inputHorm1DiffCoeff=",  inputHorm1DiffCoeff) )   return 1;
     if ( readParameter(arg, "horm1Efficacy=", horm1Efficacy) )  return 1;
@@ -111,6 +157,51 @@ int readOption(const char arg[])
     if ( readParameter(arg, "RDfeedRate=", RDfeedRate) )  return 1;
     if ( readParameter(arg, "RDfeedToKillRatio=", RDfeedToKillRatio) )  return 1;
     if ( readParameter(arg, "reactRate1to2=", reactRate1to2) )  return 1;
+    if ( readParameter(arg, "useSimd=", useSimd) )  return 1;
+    if ( readParameter(arg, "threads=", threads) )  return 1;
+    if ( readParameter(arg, "triangulationScale=", triangulationScale) )  return 1;
+    if ( readParameter(arg, "meshCheckPeriod=", meshCheckPeriod) )  return 1;
+    if ( readParameter(arg, "useContactGrid=", useContactGrid) )  return 1;
+    if ( readParameter(arg, "adaptiveTimestep=", adaptiveTimestep) )  return 1;
+    if ( readParameter(arg, "timestepMin=", timestepMin) )  return 1;
+    if ( readParameter(arg, "timestepMax=", timestepMax) )  return 1;
+    if ( readParameter(arg, "displacementTolerance=", displacementTolerance) )  return 1;
+    if ( readParameter(arg, "hormoneTolerance=", hormoneTolerance) )  return 1;
+    if ( readParameter(arg, "hormoneSolver=", hormoneSolver) )  return 1;
+    if ( readParameter(arg, "timestep=", timestep) )  return 1;
+    if ( readCount(arg, "mechSubsteps=", mechSubsteps) )  return 1;
+    if ( readParameter(arg, "seed=", seed) )  return 1;
+    if ( readParameter(arg, "randomStreams=", randomStreams) )  return 1;
+    if ( readParameter(arg, "scheduleDivisions=", scheduleDivisions) )  return 1;
+    if ( readParameter(arg, "reorderPeriod=", reorderPeriod) )  return 1;
+    if ( readParameter(arg, "cellsFile=", cellsFile) )  return 1;
+    if ( readParameter(arg, "haloWidth=", haloWidth) )  return 1;
+    if ( readParameter(arg, "rebalancePeriod=", rebalancePeriod) )  return 1;
+    if ( readParameter(arg, "rebalanceImbalance=", rebalanceImbalance) )  return 1;
+    if ( readParameter(arg, "finalTime=", finalTime) )  return 1;
+    if ( readParameter(arg, "verbose=", verbose) )  return 1;
+    if ( readParameter(arg, "display=", display) )  return 1;
+    if ( readParameter(arg, "traceFile=", traceFile) )  return 1;
+    if ( readParameter(arg, "traceCapacity=", traceCapacity) )  return 1;
+    if ( readCount(arg, "chemSubsteps=", chemSubsteps) )  return 1;
+    if ( readParameter(arg, "logLevel=", logLevel) )  return 1;
+    if ( readParameter(arg, "logPeriod=", logPeriod) )  return 1;
+    if ( readParameter(arg, "progressFile=", progressFile) )  return 1;
+    if ( readParameter(arg, "progressSteps=", progressSteps) )  return 1;
+    if ( readParameter(arg, "checkpointFile=", checkpointFile) )  return 1;
+    if ( readParameter(arg, "checkpointPeriod=", checkpointPeriod) )  return 1;
+    return 0;
+}
+
+int readOption(const char arg[])
+{
+    if (verbose) {
+        logMessage(LOG_DEBUG, "[%s]\n", arg);   /// the echo of the .cym file, logLevel=4 only
+    }
+    if ( parseOption(arg) ) {
+        optionsRead.push_back(arg);
+        return 1;
+    }
     return 0;
 }
 
@@ -119,7 +210,7 @@ void readFile(const char path[])
     std::string line;
     std::ifstream is(path);
     if ( !is.good() )
-        printf("File `%s' cannot be read\n", path);
+        logMessage(LOG_ERROR, "File `%s' cannot be read\n", path);
     while ( is.good() )
     {
         getline(is, line);
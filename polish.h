@@ -5,6 +5,7 @@
 #ifndef FRAP_POLISH_H
 #define FRAP_POLISH_H
 #define WORD  unsigned long
+#include <chrono>
 
 #endif //FRAP_POLISH_H
 
@@ -12,7 +13,10 @@
 /// size_t = size in bytes,  const means MAX is immutable
 
 const double PI = 3.14159265358979323846;
-const size_t MAX = (16384*2);
+#ifndef MAX_CELLS
+#define MAX_CELLS (16384*2)   /// leafsim_bench is built with more, to go to 100 000 cells
+#endif
+const size_t MAX = MAX_CELLS;
 const bool debugStatus = 1;
 
 
@@ -20,17 +24,23 @@ const bool debugStatus = 1;
 /// this is global and not in the main.c file to keep it tidy
 /// need to initialise the triangleIndexList pointer before delaunay triangulation
 
-Point pointsArray[MAX];
-int numTriangleVertices = 0;
-WORD* triangleIndexList;
+REPLICA_LOCAL CellStore pointsArray(MAX);
+REPLICA_LOCAL int numTriangleVertices = 0;
+REPLICA_LOCAL WORD* triangleIndexList;
 const int NAW = 80;  /// neighbourhood array width
-double currentTime = 0;   /// a tracker for how many timesteps have passed
+REPLICA_LOCAL double currentTime = 0;   /// a tracker for how many timesteps have passed
 
 /// window size in pixels
 int winW = 1000;
 int winH = 1000;
 
 
+/// seconds on a monotonic clock, for timing (glfwGetTime() needs glfwInit())
+double wallTime()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 static void error(int error, const char* text)
 {
     fprintf(stderr, "GLFW Error: %s\n", text);
@@ -44,6 +54,6 @@ void limitNbo()
     printf("The number of points used is %d \n", nbo);
 #endif
     //initialize random number generator
-    srandom(seed);
+    mySeed(seed);
 }
 
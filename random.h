@@ -3,18 +3,185 @@
  Jonathan Ward and Francois Nedelec, Copyright EMBL 2007-2009
  */
 #include <cstdlib>
+#include <stdint.h>
+#include "replica.h"
+
+/// the additive feedback generator of glibc's random() (TYPE_3), which rand() used to give us:
+/// the numbers are the same, but the state is REPLICA_LOCAL so replicas of a batch do not share it
+class LegacyRandom
+{
+public:
+    explicit LegacyRandom(unsigned int s = 1){ seed(s); }
+
+    /// same as srandom(s)
+    void seed(unsigned int s){
+        int32_t word = (s == 0) ? 1 : s;
+        state[0] = word;
+        for (int i = 1; i < 31; i++) {
+            long hi = word / 127773, lo = word % 127773;
+            word = 16807 * lo - 2836 * hi;
+            if (word < 0) word += 2147483647;
+            state[i] = word;
+        }
+        front = 3;
+        rear = 0;
+        for (int i = 0; i < 310; i++) next();
+    }
+
+    /// same as random(), in [0, RAND_MAX] with glibc's RAND_MAX
+    int next(){
+        uint32_t val = (uint32_t)state[front] + (uint32_t)state[rear];
+        state[front] = (int32_t)val;
+        front = (front + 1) % 31;
+        rear = (rear + 1) % 31;
+        return (int)(val >> 1);
+    }
+
+private:
+    int32_t state[31];
+    int front, rear;
+};
+
+const int LEGACY_RAND_MAX = 2147483647;
+REPLICA_LOCAL LegacyRandom legacyRandom;
+
+void mySeed(unsigned int s)
+{
+    legacyRandom.seed(s);
+}
+
+
+/// Counter-based generator Philox4x32-10 (Salmon et al. 2011, "Parallel random numbers: as easy as 1, 2, 3"):
+/// the numbers are a function of a key and a counter, with no state carried from one number to the next.
+/// The key is the seed, and the counter is (cell, step, purpose, draw), so every cell has its own stream
+/// at every step: the numbers do not depend on the order in which cells or threads use them, and the
+/// streams of different cells can be generated side by side (randomUniformBatch).
+/// This is used when randomStreams is set; LegacyRandom above remains for the sequence of earlier runs.
+enum RandomPurpose
+{
+    RANDOM_PLACEMENT = 1,   /// initial positions
+    RANDOM_DIVISION,        /// whether a cell divides
+    RANDOM_ORIENTATION,     /// direction of the division
+    RANDOM_LAYOUT           /// positions made by layout.h
+};
+
+inline void philoxRound(uint32_t ctr[4], const uint32_t key[2]){
+    uint64_t p0 = (uint64_t)0xD2511F53 * ctr[0];
+    uint64_t p1 = (uint64_t)0xCD9E8D57 * ctr[2];
+    uint32_t hi0 = p0 >> 32, lo0 = (uint32_t)p0;
+    uint32_t hi1 = p1 >> 32, lo1 = (uint32_t)p1;
+    ctr[0] = hi1 ^ ctr[1] ^ key[0];
+    ctr[1] = lo1;
+    ctr[2] = hi0 ^ ctr[3] ^ key[1];
+    ctr[3] = lo0;
+}
+
+/// replaces ctr by the 4 random words of (key, ctr)
+inline void philox4x32(uint32_t ctr[4], uint64_t seed){
+    uint32_t key[2] = { (uint32_t)seed, (uint32_t)(seed >> 32) };
+    for (int r = 0; r < 10; r++) {
+        if (r > 0) {
+            key[0] += 0x9E3779B9;
+            key[1] += 0xBB67AE85;
+        }
+        philoxRound(ctr, key);
+    }
+}
+
+/// compares philox4x32() with the known answers of Random123 (kat_vectors, philox4x32 with 10 rounds);
+/// returns false if any word differs
+bool philoxSelfCheck(){
+    static const uint32_t known[3][10] = {
+        /// counter, key, output
+        { 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+          0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 },
+        { 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+          0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd },
+        { 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344, 0xa4093822, 0x299f31d0,
+          0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 }
+    };
+    for (int t = 0; t < 3; t++) {
+        uint32_t ctr[4] = { known[t][0], known[t][1], known[t][2], known[t][3] };
+        philox4x32(ctr, known[t][4] | ((uint64_t)known[t][5] << 32));
+        for (int k = 0; k < 4; k++) {
+            if (ctr[k] != known[t][6 + k]) return false;
+        }
+    }
+    return true;
+}
+
+/// uniform real in (0, 1] from 32 random bits
+inline double randomUnit(uint32_t bits){
+    return (bits + 1.0) * (1.0 / 4294967296.0);
+}
+
+/// uniform real in (-1, 1) from 32 random bits
+inline double randomSigned(uint32_t bits){
+    return (bits + 0.5) * (2.0 / 4294967296.0) - 1.0;
+}
+
+/// the random numbers of one cell at one step, for one purpose
+class RandomStream
+{
+public:
+    RandomStream(uint64_t seed, RandomPurpose purpose, uint64_t step, uint32_t cell) : seed(seed){
+        counter[0] = cell;
+        counter[1] = (uint32_t)step;
+        counter[2] = ((uint32_t)(step >> 32) & 0xFFFF) | ((uint32_t)purpose << 16);
+        counter[3] = 0;
+    }
+
+    /// positive random real in (0, 1]
+    double prand(){
+        return randomUnit(next());
+    }
+
+    /// signed random real in (-1, 1)
+    double srand(){
+        return randomSigned(next());
+    }
+
+private:
+    uint64_t seed;
+    uint32_t counter[4];   /// the last word counts the blocks of 4 words used
+    uint32_t block[4];
+    int used = 4;
+
+    uint32_t next(){
+        if (used == 4) {
+            for (int k = 0; k < 4; k++) block[k] = counter[k];
+            philox4x32(block, seed);
+            counter[3]++;
+            used = 0;
+        }
+        return block[used++];
+    }
+};
+
+/// the first prand() of the streams of the count cells in cells, generated side by side
+void randomUniformBatch(uint64_t seed, RandomPurpose purpose, uint64_t step, const int* cells, int count, double* out){
+    uint32_t word1 = (uint32_t)step;
+    uint32_t word2 = ((uint32_t)(step >> 32) & 0xFFFF) | ((uint32_t)purpose << 16);
+#pragma omp simd
+    for (int i = 0; i < count; i++) {
+        uint32_t ctr[4] = { (uint32_t)cells[i], word1, word2, 0 };
+        philox4x32(ctr, seed);
+        out[i] = randomUnit(ctr[0]);
+    }
+}
+
+
 /// signed random real in [-1, 1]
 /// used to create random initial starting positions and velocities
 float mySrand()
 {
-    const float scale = 2.0 / static_cast<float>(RAND_MAX);
-    return static_cast<float>( rand() ) * scale - 1.0;
+    const float scale = 2.0 / static_cast<float>(LEGACY_RAND_MAX);
+    return static_cast<float>( legacyRandom.next() ) * scale - 1.0;
 }
 
 /// positive random real in [0, 1]
 float myPrand()
 {
-    const float scale = 1.0 / ( 1+static_cast<float>(RAND_MAX) );
-    return static_cast<float>( 1+rand() ) * scale;
+    const float scale = 1.0 / ( 1+static_cast<float>(LEGACY_RAND_MAX) );
+    return static_cast<float>( 1+legacyRandom.next() ) * scale;
 }
-
@@ -0,0 +1,121 @@
+//
+// Cells sorted along a space-filling curve, so that neighbours are close in memory
+//
+
+#ifndef FRAP_REORDER_H
+#define FRAP_REORDER_H
+#include <stdint.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+/// Daughters are added at the end of pointsArray, far from their mothers, so as the tissue grows the
+/// loops over the edges (springs, diffusion) read the cells at random places in memory. Every
+/// reorderPeriod steps the cells are sorted by the position of their centre along a Hilbert curve
+/// covering the tissue, which keeps the cells that are close in space close in memory.
+/// Every array indexed by cell follows: the CellStore, the mesh, the corrections of the IMEX solver
+/// and the division scheduler. The edges and neighbours are rebuilt at every step anyway.
+/// cellId stays with each cell, and the random streams are keyed by it, so the random numbers of a
+/// cell do not depend on where it is stored. The sums over the cells are still done in another order,
+/// so a reordered run is deterministic but only statistically equivalent to one without reordering.
+
+/// distance along the Hilbert curve of order 16 to the point (x, y), both in [0, 65536)
+inline uint32_t hilbertKey(uint32_t x, uint32_t y){
+    uint32_t key = 0;
+    for (uint32_t s = 1u << 15; s > 0; s >>= 1) {
+        uint32_t rx = (x & s) ? 1 : 0;
+        uint32_t ry = (y & s) ? 1 : 0;
+        key += s * s * ((3 * rx) ^ ry);
+        if (ry == 0) {   /// rotate the quadrant
+            if (rx == 1) {
+                x = s - 1 - (x & (s - 1));
+                y = s - 1 - (y & (s - 1));
+            }
+            std::swap(x, y);
+        }
+        x &= s - 1;
+        y &= s - 1;
+    }
+    return key;
+}
+
+REPLICA_LOCAL std::vector<std::pair<uint32_t, int>> reorderKeys;
+REPLICA_LOCAL std::vector<int> reorderOrder, reorderIndex;
+
+/// array[k] = old array[order[k]] for the first order.size() elements, order being a permutation or a subset
+template <typename T>
+void applyOrder(std::vector<T>& array, const std::vector<int>& order){
+    int extent = order.empty() ? 0 : *std::max_element(order.begin(), order.end()) + 1;
+    std::vector<T> old(array.begin(), array.begin() + extent);
+#pragma omp parallel for schedule(static)
+    for (int k = 0; k < (int)order.size(); k++) {
+        array[k] = old[order[k]];
+    }
+}
+
+/// every array of the CellStore: cell order[k] becomes cell k
+void applyCellOrder(const std::vector<int>& order){
+    applyOrder(pointsArray.disVec, order);
+    applyOrder(pointsArray.springVec, order);
+    applyOrder(pointsArray.cellRadiusBase, order);
+    applyOrder(pointsArray.cellRadius, order);
+    applyOrder(pointsArray.myTotalHormone1, order);
+    applyOrder(pointsArray.myDeltaHormone1, order);
+    applyOrder(pointsArray.myTotalHormone2, order);
+    applyOrder(pointsArray.myDeltaHormone2, order);
+    applyOrder(pointsArray.isHormone1Producer, order);
+    applyOrder(pointsArray.isHormone2Producer, order);
+    applyOrder(pointsArray.cellId, order);
+}
+
+/// sort the nbo cells along the Hilbert curve of their bounding box, to be called between steps
+void reorderCells(){
+    TRACE_SCOPE("reorder");
+    int numCells = nbo;
+    if (numCells < 2) return;
+    const std::vector<vector2D>& pos = pointsArray.disVec;
+    double xMin = pos[0].xx, xMax = pos[0].xx, yMin = pos[0].yy, yMax = pos[0].yy;
+    for (int i = 1; i < numCells; i++) {
+        xMin = std::min(xMin, pos[i].xx);
+        xMax = std::max(xMax, pos[i].xx);
+        yMin = std::min(yMin, pos[i].yy);
+        yMax = std::max(yMax, pos[i].yy);
+    }
+    double scale = 65535 / std::max(std::max(xMax - xMin, yMax - yMin), 1e-300);
+
+    reorderKeys.resize(numCells);
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < numCells; i++) {
+        uint32_t x = (uint32_t)((pos[i].xx - xMin) * scale);
+        uint32_t y = (uint32_t)((pos[i].yy - yMin) * scale);
+        reorderKeys[i] = std::make_pair(hilbertKey(x, y), i);
+    }
+    std::sort(reorderKeys.begin(), reorderKeys.end());
+
+    reorderOrder.resize(numCells);   /// old index of the cell now at k
+    reorderIndex.resize(numCells);   /// new index of the cell that was at i
+    bool changed = false;
+    for (int k = 0; k < numCells; k++) {
+        reorderOrder[k] = reorderKeys[k].second;
+        reorderIndex[reorderKeys[k].second] = k;
+        changed |= (reorderKeys[k].second != k);
+    }
+    if (!changed) return;
+
+    applyCellOrder(reorderOrder);
+    for (std::vector<double>* correction : {&hormoneIMEX.correction1, &hormoneIMEX.correction2}) {
+        if (!correction->empty()) {
+            correction->resize(numCells, 0);   /// cells without one start from 0 as in solveDiffusion()
+            applyOrder(*correction, reorderOrder);
+        }
+    }
+    if (leafMesh.valid && leafMesh.numVerts == numCells) {
+        leafMesh.renumber(reorderIndex);
+    }
+    else {
+        leafMesh.invalidate();   /// it also covers the copies of other ranks (domain.h), rebuilt at the next step
+    }
+    divisionScheduler.reorder(reorderOrder);
+}
+
+#endif //FRAP_REORDER_H
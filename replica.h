@@ -0,0 +1,16 @@
+//
+// Storage class of the simulation state
+//
+
+#ifndef FRAP_REPLICA_H
+#define FRAP_REPLICA_H
+
+/// The state of a simulation (parameters, cells, neighbours, random generator) is kept in globals.
+/// The batch build (batch.cc) defines REPLICA_LOCAL as thread_local before including the headers, so
+/// that each of its threads runs a replica of its own. In the normal build they are plain globals,
+/// which the OpenMP loops of the one simulation share.
+#ifndef REPLICA_LOCAL
+#define REPLICA_LOCAL
+#endif
+
+#endif //FRAP_REPLICA_H
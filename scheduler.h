@@ -0,0 +1,173 @@
+//
+// Division times of the cells, scheduled in advance instead of drawn at every step
+//
+
+#ifndef FRAP_SCHEDULER_H
+#define FRAP_SCHEDULER_H
+#include <math.h>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/// Next reaction method (Gibson & Bruck 2000, with the internal times of Anderson 2007): divisionProb()
+/// per referenceTimestep is the hazard of a cell, its rate of division per unit time. Each cell draws
+/// target, a unit exponential, once, and divides when its hazard integrated over time reaches target.
+/// While the hazard is constant the time of the division is known in advance, so the cells sit in a
+/// priority queue ordered by that time and a step only takes out the cells due before its end.
+/// When the hazard of a cell changes, what it has integrated so far is kept and its time is predicted
+/// again from the new hazard, without drawing a new number.
+/// divisionProb() depends on the number of cells and on hormone 1 only through nbo / DesiredTotalCells,
+/// computed in integers: the hazards are all updated when this quotient changes, and at every step
+/// while it is not zero, since hormone 1 then changes the hazard. Otherwise they are left alone.
+/// The division of a cell in a step has probability 1 - exp(-hazard * timestep) instead of
+/// hazard * timestep with one trial per step, the same to first order in the step.
+class DivisionScheduler
+{
+public:
+    std::vector<double> target;       /// integrated hazard at which each cell divides
+    std::vector<double> integrated;   /// hazard integrated up to time updated
+    std::vector<double> hazard;       /// divisions per unit time
+    std::vector<double> updated;
+    int hazardKey = -1;               /// nbo / DesiredTotalCells when the hazards were computed, -1 for never
+    long numUpdates = 0;              /// number of times all the hazards were computed again
+
+    /// forget every cell, for a new simulation
+    void reset(){
+        target.clear();
+        integrated.clear();
+        hazard.clear();
+        updated.clear();
+        queue.clear();
+        hazardKey = -1;
+    }
+
+    /// divisions per unit time of cell i, among totalCells
+    static double hazardOf(int i, int totalCells){
+        double prob = pointsArray[i].divisionProb(baseMaxProbOfDiv, totalCells, DesiredTotalCells);
+        return std::max(prob, 0.0) / referenceTimestep;
+    }
+
+    static int keyOf(int totalCells){
+        return totalCells / (int)DesiredTotalCells;   /// as in divisionProb()
+    }
+
+    /// time at which cell i will divide if its hazard does not change
+    double predicted(int i) const{
+        if (hazard[i] <= 0) return INFINITY;
+        return updated[i] + (target[i] - integrated[i]) / hazard[i];
+    }
+
+    /// give cell i a new target from draw, in (0, 1], and start integrating at time now
+    void start(int i, double now, double draw, int totalCells){
+        if (i >= (int)target.size()) {
+            target.resize(i + 1, 0);
+            integrated.resize(i + 1, 0);
+            hazard.resize(i + 1, 0);
+            updated.resize(i + 1, 0);
+        }
+        target[i] = -log(draw);
+        integrated[i] = 0;
+        updated[i] = now;
+        hazard[i] = hazardOf(i, totalCells);
+        push(i);
+    }
+
+    /// bring the hazards of the first numCells cells up to date at time now, new cells get a target
+    /// from their random stream of this step; totalCells counts the cells of all the ranks (domain.h)
+    void update(int numCells, int totalCells, double now, int64_t step){
+        if ((int)target.size() > numCells) {
+            reset();   /// the cells were placed again
+        }
+        int first = target.size();
+        for (int i = first; i < numCells; i++) {
+            start(i, now, RandomStream(seed, RANDOM_DIVISION, step, pointsArray.cellId[i]).prand(), totalCells);
+        }
+        int key = keyOf(totalCells);
+        if (key == hazardKey && key == 0) {
+            return;
+        }
+        hazardKey = key;
+        numUpdates++;
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < numCells; i++) {
+            integrated[i] += hazard[i] * (now - updated[i]);
+            updated[i] = now;
+            hazard[i] = hazardOf(i, totalCells);
+        }
+        rebuildQueue(numCells);
+    }
+
+    /// take out the cells due to divide by time end, in increasing order of index
+    void takeDue(double end, std::vector<int>& due){
+        due.clear();
+        while (!queue.empty() && queue.front().first <= end) {
+            std::pair<double, int> top = queue.front();
+            std::pop_heap(queue.begin(), queue.end(), std::greater<std::pair<double, int>>());
+            queue.pop_back();
+            if (top.first == predicted(top.second)) {   /// otherwise the cell was queued again since
+                due.push_back(top.second);
+            }
+        }
+        std::sort(due.begin(), due.end());
+        due.erase(std::unique(due.begin(), due.end()), due.end());
+    }
+
+    /// the cells were reordered, cell order[k] becoming cell k
+    void reorder(const std::vector<int>& order){
+        if (target.size() != order.size()) {
+            reset();   /// not in use, the cells will be started again
+            return;
+        }
+        keep(order);
+    }
+
+    /// only the cells order[k] are kept, becoming cell k
+    void keep(const std::vector<int>& order){
+        int numCells = order.size();
+        for (std::vector<double>* array : {&target, &integrated, &hazard, &updated}) {
+            std::vector<double> old(*array);
+            array->resize(numCells);
+            for (int k = 0; k < numCells; k++) {
+                (*array)[k] = old[order[k]];
+            }
+        }
+        rebuildQueue(numCells);
+    }
+
+    /// a cell coming from another rank, with its state there, as cell target.size()
+    void append(double cellTarget, double cellIntegrated, double cellHazard, double cellUpdated){
+        target.push_back(cellTarget);
+        integrated.push_back(cellIntegrated);
+        hazard.push_back(cellHazard);
+        updated.push_back(cellUpdated);
+        push(target.size() - 1);
+    }
+
+    /// the queue from the state of the cells only, after the state was restored
+    void rebuildQueue(int numCells){
+        queue.clear();
+        for (int i = 0; i < numCells; i++) {
+            double time = predicted(i);
+            if (time < INFINITY) {
+                queue.push_back(std::make_pair(time, i));
+            }
+        }
+        std::make_heap(queue.begin(), queue.end(), std::greater<std::pair<double, int>>());
+    }
+
+private:
+    std::vector<std::pair<double, int>> queue;   /// (predicted time, cell), a min-heap; may hold stale entries
+
+    void push(int i){
+        double time = predicted(i);
+        if (time < INFINITY) {
+            queue.push_back(std::make_pair(time, i));
+            std::push_heap(queue.begin(), queue.end(), std::greater<std::pair<double, int>>());
+        }
+    }
+};
+
+REPLICA_LOCAL DivisionScheduler divisionScheduler;
+
+#endif //FRAP_SCHEDULER_H
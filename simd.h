@@ -0,0 +1,202 @@
+//
+// Vectorised spring kernel, processes 4 (AVX2) or 8 (AVX-512) edges at once
+//
+
+#ifndef FRAP_SIMD_H
+#define FRAP_SIMD_H
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_X86 true
+#else
+#define SIMD_X86 false
+#endif
+
+/// The spring coefficient of each edge is computed for a batch of edges with no branches: every regime
+/// (ignored, attracted, compressed, inner compressed) is evaluated and the right one is picked with masks.
+/// The positions and radii of the end points are gathered from the arrays of the CellStore.
+/// The forces are then added to both ends with scalar code, as two edges of a batch can share a point.
+/// Each kernel does the same floating point operations in the same order as springCoefficient(),
+/// so all of them give the same results as v4CalcSprings.
+
+/// fills dx, dy (second - first) and the summed spring coefficient for count edges
+typedef void (*SpringBatchKernel)(const double* xy, const double* radius, const int* first, const int* second,
+                                  int count, double* dx, double* dy, double* coefficient);
+
+void springBatchScalar(const double* xy, const double* radius, const int* first, const int* second,
+                       int count, double* dx, double* dy, double* coefficient){
+    for (int e = 0; e < count; e++) {
+        int i = first[e], j = second[e];
+        dx[e] = xy[2*j] - xy[2*i];
+        dy[e] = xy[2*j+1] - xy[2*i+1];
+        double distance = sqrt(dx[e] * dx[e] + dy[e] * dy[e]);
+        coefficient[e] = springCoefficient(radius[i], distance) + springCoefficient(radius[j], distance);
+    }
+}
+
+#if SIMD_X86
+/// no fused multiply-adds, they would round differently from the scalar code
+#if defined(__clang__)
+#define SIMD_TARGET(isa) __attribute__((target(isa)))
+#else
+#define SIMD_TARGET(isa) __attribute__((target(isa), optimize("fp-contract=off")))
+#endif
+
+SIMD_TARGET("avx2")
+static inline __m256d springCoefficientAVX2(__m256d radius, __m256d distance){
+    const __m256d zero = _mm256_setzero_pd();
+    __m256d deltaMagnitude = _mm256_sub_pd(distance, radius);
+    __m256d innerLimit = _mm256_mul_pd(_mm256_set1_pd(-0.95), radius);
+
+    __m256d broken = _mm256_cmp_pd(deltaMagnitude, _mm256_mul_pd(_mm256_set1_pd(breakSpringCoeff), radius), _CMP_GT_OQ);
+    __m256d extended = _mm256_cmp_pd(deltaMagnitude, zero, _CMP_GT_OQ);
+    __m256d negative = _mm256_cmp_pd(deltaMagnitude, zero, _CMP_LT_OQ);
+    __m256d compressed = _mm256_and_pd(negative, _mm256_cmp_pd(deltaMagnitude, innerLimit, _CMP_GT_OQ));
+    __m256d inner = _mm256_and_pd(negative, _mm256_cmp_pd(deltaMagnitude, innerLimit, _CMP_LT_OQ));
+
+    __m256d attract = _mm256_mul_pd(_mm256_div_pd(deltaMagnitude, distance), _mm256_set1_pd(pointsArray.extendedHooks));
+    __m256d result = _mm256_and_pd(inner, _mm256_set1_pd(-pointsArray.innerCompressedHooks));
+    result = _mm256_blendv_pd(result, _mm256_set1_pd(-pointsArray.compressedHooks), compressed);
+    result = _mm256_blendv_pd(result, attract, extended);
+    return _mm256_andnot_pd(broken, result);
+}
+
+/// gathers are masked with every lane on, the unmasked ones trip -Wmaybe-uninitialized in gcc 12
+SIMD_TARGET("avx2")
+static inline __m256d gatherAVX2(const double* base, __m128i index){
+    const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), base, index, all, 8);
+}
+
+SIMD_TARGET("avx2")
+void springBatchAVX2(const double* xy, const double* radius, const int* first, const int* second,
+                     int count, double* dx, double* dy, double* coefficient){
+    int e = 0;
+    for (; e + 4 <= count; e += 4) {
+        __m128i i = _mm_loadu_si128((const __m128i*)(first + e));
+        __m128i j = _mm_loadu_si128((const __m128i*)(second + e));
+        __m128i i2 = _mm_slli_epi32(i, 1), j2 = _mm_slli_epi32(j, 1);   /// positions are stored x, y, x, y ...
+        __m256d ddx = _mm256_sub_pd(gatherAVX2(xy, j2), gatherAVX2(xy, i2));
+        __m256d ddy = _mm256_sub_pd(gatherAVX2(xy + 1, j2), gatherAVX2(xy + 1, i2));
+        __m256d distance = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(ddx, ddx), _mm256_mul_pd(ddy, ddy)));
+        __m256d coef = _mm256_add_pd(springCoefficientAVX2(gatherAVX2(radius, i), distance),
+                                     springCoefficientAVX2(gatherAVX2(radius, j), distance));
+        _mm256_storeu_pd(dx + e, ddx);
+        _mm256_storeu_pd(dy + e, ddy);
+        _mm256_storeu_pd(coefficient + e, coef);
+    }
+    springBatchScalar(xy, radius, first + e, second + e, count - e, dx + e, dy + e, coefficient + e);
+}
+
+SIMD_TARGET("avx512f")
+static inline __m512d springCoefficientAVX512(__m512d radius, __m512d distance){
+    const __m512d zero = _mm512_setzero_pd();
+    __m512d deltaMagnitude = _mm512_sub_pd(distance, radius);
+    __m512d innerLimit = _mm512_mul_pd(_mm512_set1_pd(-0.95), radius);
+
+    __mmask8 broken = _mm512_cmp_pd_mask(deltaMagnitude, _mm512_mul_pd(_mm512_set1_pd(breakSpringCoeff), radius), _CMP_GT_OQ);
+    __mmask8 extended = _mm512_cmp_pd_mask(deltaMagnitude, zero, _CMP_GT_OQ);
+    __mmask8 negative = _mm512_cmp_pd_mask(deltaMagnitude, zero, _CMP_LT_OQ);
+    __mmask8 compressed = negative & _mm512_cmp_pd_mask(deltaMagnitude, innerLimit, _CMP_GT_OQ);
+    __mmask8 inner = negative & _mm512_cmp_pd_mask(deltaMagnitude, innerLimit, _CMP_LT_OQ);
+
+    __m512d attract = _mm512_mul_pd(_mm512_div_pd(deltaMagnitude, distance), _mm512_set1_pd(pointsArray.extendedHooks));
+    __m512d result = _mm512_maskz_mov_pd(inner, _mm512_set1_pd(-pointsArray.innerCompressedHooks));
+    result = _mm512_mask_blend_pd(compressed, result, _mm512_set1_pd(-pointsArray.compressedHooks));
+    result = _mm512_mask_blend_pd(extended, result, attract);
+    return _mm512_maskz_mov_pd(~broken, result);
+}
+
+SIMD_TARGET("avx512f")
+static inline __m512d gatherAVX512(const double* base, __m256i index){
+    return _mm512_mask_i32gather_pd(_mm512_setzero_pd(), 0xFF, index, base, 8);
+}
+
+SIMD_TARGET("avx512f")
+void springBatchAVX512(const double* xy, const double* radius, const int* first, const int* second,
+                       int count, double* dx, double* dy, double* coefficient){
+    int e = 0;
+    for (; e + 8 <= count; e += 8) {
+        __m256i i = _mm256_loadu_si256((const __m256i*)(first + e));
+        __m256i j = _mm256_loadu_si256((const __m256i*)(second + e));
+        __m256i i2 = _mm256_add_epi32(i, i), j2 = _mm256_add_epi32(j, j);   /// positions are stored x, y, x, y ...
+        __m512d ddx = _mm512_sub_pd(gatherAVX512(xy, j2), gatherAVX512(xy, i2));
+        __m512d ddy = _mm512_sub_pd(gatherAVX512(xy + 1, j2), gatherAVX512(xy + 1, i2));
+        __m512d distance = _mm512_maskz_sqrt_pd(0xFF, _mm512_add_pd(_mm512_mul_pd(ddx, ddx), _mm512_mul_pd(ddy, ddy)));
+        __m512d coef = _mm512_add_pd(springCoefficientAVX512(gatherAVX512(radius, i), distance),
+                                     springCoefficientAVX512(gatherAVX512(radius, j), distance));
+        _mm512_storeu_pd(dx + e, ddx);
+        _mm512_storeu_pd(dy + e, ddy);
+        _mm512_storeu_pd(coefficient + e, coef);
+    }
+    springBatchScalar(xy, radius, first + e, second + e, count - e, dx + e, dy + e, coefficient + e);
+}
+
+#endif //SIMD_X86
+
+/// pick the widest kernel the CPU running the programme supports
+SpringBatchKernel selectSpringKernel(bool allowSimd){
+#if SIMD_X86
+    if (allowSimd) {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            logMessage(LOG_INFO, "Spring kernel: AVX-512\n");
+            return springBatchAVX512;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            logMessage(LOG_INFO, "Spring kernel: AVX2\n");
+            return springBatchAVX2;
+        }
+    }
+#endif
+    logMessage(LOG_INFO, "Spring kernel: scalar\n");
+    return springBatchScalar;
+}
+
+/// same forces as v4CalcSprings, with the coefficients computed a batch of edges at a time
+/// the batches are shared between the threads, then each point adds up the forces of its own edges
+/// in edge order, so the result is the same whatever the number of threads
+void v5CalcSprings(const EdgeList& edges){
+    TRACE_SCOPE("springs");
+    static REPLICA_LOCAL SpringBatchKernel kernel = NULL;   /// chosen again whenever useSimd changes (batch replicas, leafsim_core)
+    static REPLICA_LOCAL bool kernelSimd = false;
+    if (kernel == NULL || kernelSimd != useSimd) {
+        kernel = selectSpringKernel(useSimd);
+        kernelSimd = useSimd;
+    }
+    static REPLICA_LOCAL std::vector<double> dx, dy, coefficient;
+    const int batch = 256;
+    int numEdges = edges.size();
+    dx.resize(numEdges);
+    dy.resize(numEdges);
+    coefficient.resize(numEdges);
+
+    const double* xy = (const double*)pointsArray.disVec.data();
+    const double* radius = pointsArray.cellRadius.data();
+    std::vector<vector2D>& springVec = pointsArray.springVec;
+
+#pragma omp parallel for schedule(static)
+    for (int start = 0; start < numEdges; start += batch) {
+        int count = std::min(batch, numEdges - start);
+        kernel(xy, radius, edges.first.data() + start, edges.second.data() + start, count,
+               dx.data() + start, dy.data() + start, coefficient.data() + start);
+    }
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < nbo; i++) {
+        vector2D total = vector2D(0, 0);
+        for (int k = edges.incidentOffsets[i]; k < edges.incidentOffsets[i+1]; k++) {
+            int e = edges.incident[k];
+            vector2D force = vector2D(dx[e], dy[e]) * coefficient[e];
+            if (edges.first[e] == i) {
+                total += force;
+            }
+            else {
+                total -= force;
+            }
+        }
+        springVec[i] = total;
+    }
+}
+
+#endif //FRAP_SIMD_H
@@ -0,0 +1,411 @@
+//
+// One step of the simulation, shared by the interactive programme (main.cc) and the batch runner (batch.cc)
+//
+
+#ifndef FRAP_SIMULATION_H
+#define FRAP_SIMULATION_H
+#include <float.h>
+
+/// brings the delaunay triangulation up to date, repairing the mesh from the last step where possible
+void create_triangles_list(){
+    TRACE_SCOPE("triangulation");
+    leafMesh.update(nbo);
+    triangleIndexList = leafMesh.indexList.data();
+    numTriangleVertices = leafMesh.indexList.size();
+
+#if DEBUG
+    printf("\nThere are %d points moving around \n", nbo);
+    printf("\nThe number of vertices defined by numTriangleVertices is %d\n", numTriangleVertices);
+    /*printf("int has size %ld \n", sizeof(int ));
+    printf("\ntriangleIndexList contains the values: ");
+    for (int i = 0; i < numTriangleVertices; i++)
+        printf("%u, ", triangleIndexList[i]);
+    printf("\n");*/
+#endif ///DEBUG
+}
+
+void iterateDisplace(){
+    TRACE_SCOPE("displace");
+#pragma omp parallel for schedule(static)
+    for(int i = 0; i<nbo; i++){
+        pointsArray[i].step();
+    }
+}
+
+double trackTime(){
+    return currentTime += timestep;
+}
+
+/// adaptive stepping: the largest step that moves no cell by more than displacementTolerance of its radius
+/// with the current spring forces, and changes no hormone by more than hormoneLimit allows (from the last
+/// hormone update), in each of the substeps. The step grows by half at most from one step to the next,
+/// stays within [timestepMin, timestepMax] and is shortened to land on finalTime.
+double chooseTimestep(double hormoneLimit, double timeLeft){
+    double moveRate = 0;   /// largest speed of a cell in cell radii per second
+    int numOwned = ownedCells();
+#pragma omp parallel for schedule(static) reduction(max:moveRate)
+    for (int i = 0; i < numOwned; i++) {
+        double radius = pointsArray.cellRadius[i];
+        double speed = pointsArray.springVec[i].magnitude() / (mobilityCoefficient * radius/SCALING_FACTOR);   /// as in Point::step()
+        moveRate = std::max(moveRate, speed / radius);
+    }
+    moveRate = globalMax(moveRate);   /// the same step on every rank (domain.h)
+    double step = std::min(timestepMax, 1.5 * timestep);
+    if (moveRate > 0) {
+        step = std::min(step, mechSubsteps * displacementTolerance / moveRate);
+    }
+    step = std::max(std::min(step, chemSubsteps * hormoneLimit), timestepMin);
+    if (timeLeft > 0) {
+        step = std::min(step, timeLeft);
+    }
+    return step;
+}
+
+/// moves the points over one timestep in mechSubsteps substeps, recomputing the spring forces on the
+/// same edge list; the forces of the first substep must already be in springVec
+void mechanicsStep(const EdgeList& edges){
+    TRACE_SCOPE("mechanics");
+    double step = timestep;
+    timestep = step / mechSubsteps;   /// Point::step() uses the global timestep
+    for (int s = 0; s < mechSubsteps; s++) {
+#if MOVING_POINTS
+        if (s > 0) {
+            v5CalcSprings(edges);
+        }
+#endif
+        iterateDisplace();
+        refreshHalo(pointsArray.disVec.data());
+    }
+    timestep = step;
+}
+
+/// updates the hormones over one timestep in chemSubsteps substeps on the same edge list,
+/// hormoneLimit gets the largest substep allowed by the last explicit update (adaptive timestep only)
+void chemistryStep(const EdgeList& edges, double& hormoneLimit){
+    TRACE_SCOPE("chemistry");
+    double step = timestep;
+    timestep = step / chemSubsteps;
+    for (int s = 0; s < chemSubsteps; s++) {
+        if (hormoneSolver == 1) {
+            imexUpdateHormone(edges, hormone2IntroTime);   /// stable at any step, no hormone limit
+        }
+        else {
+            calcHormBirthDeath();
+            v2DiffuseHorm(edges);
+            hormReactDiffuse(hormone2IntroTime);
+            if (adaptiveTimestep) {
+                hormoneLimit = hormoneStepLimit();
+            }
+            globalUpdateHormone();
+        }
+        refreshHalo(pointsArray.myTotalHormone1.data());
+        refreshHalo(pointsArray.myTotalHormone2.data());
+    }
+    timestep = step;
+}
+
+REPLICA_LOCAL int64_t stepCount = 0;           /// steps since initSimulation(), part of the key of the random streams
+REPLICA_LOCAL std::vector<double> divisionDraws;      /// one random number per cell, for calcMitosis()
+REPLICA_LOCAL std::vector<int> daughterSlots;         /// per cell: 1 if it divides, then the number of divisions before it
+REPLICA_LOCAL std::vector<int> dividingCells;         /// the cells dividing in this step, in increasing order
+REPLICA_LOCAL std::vector<double> divisionTimes;      /// per dividing cell: when it was due
+
+/// the random numbers of a cell during this step
+RandomStream cellRandom(RandomPurpose purpose, int cell){
+    return RandomStream(seed, purpose, stepCount, pointsArray.cellId[cell]);
+}
+
+/// the sequence of the earlier versions (randomStreams=0): one cell after the other, drawing from
+/// LegacyRandom, daughters appended as they are made and tested again later in the same loop
+void calcMitosisSequential(){
+    double stepScale = timestep / referenceTimestep;   /// the probabilities are per step of referenceTimestep
+    for (int i = 0; i < nbo; i++){
+        Point motherCell = pointsArray[i];
+        if (myPrand() < stepScale * motherCell.divisionProb(baseMaxProbOfDiv, nbo, DesiredTotalCells)){
+
+            nbo++; /// MAX points already exist, need to increase pointer by one to access new cell
+
+            Point daughterCell = pointsArray[nbo-1];
+            pointsArray.cellId[nbo-1] = pointsArray.nextId++;
+            vector2D OrientVec = vector2D(mySrand(), mySrand())
+                               + (motherCell.myTotalHormone1*horm1Efficacy*horm1DivOrient)
+                               + (motherCell.myTotalHormone2*horm2Efficacy*horm2DivOrient);
+            vector2D normOrient = OrientVec.normalise();
+
+            vector2D displaceVec = 0.5 * motherCell.cellRadius * normOrient;
+            daughterCell.disVec = motherCell.disVec + displaceVec; /// change daughter cell to inherit mother cell position + random orientation
+            motherCell.disVec -= displaceVec;  /// mother cell displaced in opposite direction
+            if (!useContactGrid) {
+                leafMesh.queueInsert(nbo-1, i);  /// daughter is added to the existing mesh next to its mother
+            }
+        }
+    }
+}
+
+/// the cells in dividingCells divide, their daughters going after the numMothers existing cells; each
+/// mother draws the direction of the division from its own random stream
+/// The mothers are handled in parallel, and the daughters are queued for the mesh together.
+/// Returns the number of divisions, fewer than requested if the store is full.
+int divideCells(int numMothers){
+    /// in the order of the ids of the mothers, so that the daughters get the same ids wherever the
+    /// mothers are stored; without reorderCells() this is the order of the indices
+    const std::vector<int>& ids = pointsArray.cellId;
+    std::sort(dividingCells.begin(), dividingCells.end(), [&ids](int a, int b){ return ids[a] < ids[b]; });
+    int numDaughters = dividingCells.size();
+    int room = (int)MAX - 1 - numMothers;   /// as limitNbo(), the last slot stays free
+    if (numDaughters > room) {
+        logMessage(LOG_WARNING, "%d divisions, but room for %d cells only\n", numDaughters, room);
+        numDaughters = std::max(room, 0);
+    }
+    int firstId = reserveCellIds(numDaughters);
+
+#pragma omp parallel for schedule(static)
+    for (int d = 0; d < numDaughters; d++) {
+        int i = dividingCells[d];
+        Point motherCell = pointsArray[i];
+        Point daughterCell = pointsArray[numMothers + d];
+        pointsArray.cellId[numMothers + d] = firstId + d;
+        RandomStream random = cellRandom(RANDOM_ORIENTATION, i);
+        double x = random.srand();
+        vector2D OrientVec = vector2D(x, random.srand())
+                           + (motherCell.myTotalHormone1*horm1Efficacy*horm1DivOrient)
+                           + (motherCell.myTotalHormone2*horm2Efficacy*horm2DivOrient);
+        vector2D normOrient = OrientVec.normalise();
+
+        vector2D displaceVec = 0.5 * motherCell.cellRadius * normOrient;
+        daughterCell.disVec = motherCell.disVec + displaceVec; /// change daughter cell to inherit mother cell position + random orientation
+        motherCell.disVec -= displaceVec;  /// mother cell displaced in opposite direction
+    }
+    nbo = numMothers + numDaughters;
+
+    if (!useContactGrid) {
+        /// daughters are added to the existing mesh next to their mothers
+        for (int d = 0; d < numDaughters; d++) {
+            leafMesh.queueInsert(numMothers + d, dividingCells[d]);
+        }
+    }
+    return numDaughters;
+}
+
+/// one trial per cell and step (scheduleDivisions=0), in two passes over the cells:
+///   - each cell decides whether it divides, with the number of cells of the start of the step
+///   - a prefix sum over the decisions gives each daughter its slot after the existing cells
+/// Both passes run in parallel and the result does not depend on the number of threads.
+void chooseDividingCells(int numMothers){
+    double stepScale = timestep / referenceTimestep;   /// the probabilities are per step of referenceTimestep
+    divisionDraws.resize(numMothers);
+    daughterSlots.resize(numMothers + 1);
+    randomUniformBatch(seed, RANDOM_DIVISION, stepCount, pointsArray.cellId.data(), numMothers, divisionDraws.data());
+    int totalCells = allCells();
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < numMothers; i++) {
+        Point motherCell = pointsArray[i];
+        daughterSlots[i] = (divisionDraws[i] < stepScale * motherCell.divisionProb(baseMaxProbOfDiv, totalCells, DesiredTotalCells));
+    }
+
+    /// exclusive prefix sum: daughterSlots[i] becomes the number of dividing cells before i
+    int numDaughters = 0;
+    for (int i = 0; i < numMothers; i++) {
+        int divides = daughterSlots[i];
+        daughterSlots[i] = numDaughters;
+        numDaughters += divides;
+    }
+    daughterSlots[numMothers] = numDaughters;
+
+    dividingCells.resize(numDaughters);
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < numMothers; i++) {
+        if (daughterSlots[i+1] > daughterSlots[i]) {
+            dividingCells[daughterSlots[i]] = i;
+        }
+    }
+}
+
+// TODO add a check so that cells cannot divide immediately after dividing again
+/// divisions of the cells that exist at the start of the step
+/// By default the cells due before the end of the step are taken from divisionScheduler (scheduler.h),
+/// which draws one number per division rather than one per cell and step. Mothers and daughters then
+/// start a new wait for their next division, from the time the mother was due.
+void calcMitosis(){
+    TRACE_SCOPE("mitosis");
+    if (!randomStreams) {
+        calcMitosisSequential();
+        return;
+    }
+    int numMothers = nbo;
+    if (!scheduleDivisions) {
+        chooseDividingCells(numMothers);
+        divideCells(numMothers);
+        return;
+    }
+
+    divisionScheduler.update(numMothers, allCells(), currentTime, stepCount);
+    divisionScheduler.takeDue(currentTime + timestep, dividingCells);
+    int numDaughters = divideCells(numMothers);
+    divisionTimes.resize(dividingCells.size());
+    for (size_t d = 0; d < dividingCells.size(); d++) {
+        divisionTimes[d] = divisionScheduler.predicted(dividingCells[d]);
+    }
+    for (size_t d = 0; d < dividingCells.size(); d++) {
+        int i = dividingCells[d];
+        RandomStream random = cellRandom(RANDOM_DIVISION, i);
+        random.prand();   /// the first number started the cell if it is new in this step
+        divisionScheduler.start(i, divisionTimes[d], random.prand(), allCells());
+        if ((int)d < numDaughters) {
+            divisionScheduler.start(numMothers + d, divisionTimes[d], cellRandom(RANDOM_DIVISION, numMothers + d).prand(), allCells());
+        }
+    }
+}
+
+/// outcome of a step
+enum StepResult
+{
+    STEP_RUNNING = 0,   /// finalTime is not reached yet
+    STEP_FINISHED,      /// finalTime is reached, the shape can be measured
+    STEP_FAILED         /// the hormones went NaN
+};
+
+REPLICA_LOCAL double hormoneLimit = DBL_MAX;   /// largest step allowed by the hormones, from the previous step
+
+/// the parts of a step, in order
+enum StepPart
+{
+    PART_MITOSIS = 0,   /// reordering, divisions and halo exchange
+    PART_CONTACTS,      /// mesh update, or contact grid
+    PART_NEIGHBOURS,    /// neighbour graph and edge list
+    PART_MECHANICS,     /// spring forces, timestep and displacement
+    PART_CHEMISTRY,     /// hormone reactions and diffusion
+    NUM_STEP_PARTS
+};
+
+/// if set, called at the end of each part of simulationStep(): leafsim_bench times them
+REPLICA_LOCAL void (*stepPartDone)(StepPart part) = NULL;
+
+void markStepPart(StepPart part){
+    if (stepPartDone) stepPartDone(part);
+}
+
+/// start from the seeded random positions, once the parameters are read
+/// with the default seed the cells are where the CellStore constructor put them
+void initSimulation(){
+#if DEBUG
+    if (randomStreams && !philoxSelfCheck()) {
+        logMessage(LOG_ERROR, "Philox4x32-10 does not give the known answers, the random streams are wrong\n");
+    }
+#endif
+    limitNbo();
+    pointsArray.clearCells(0, pointsArray.disVec.size());   /// hormones and producers of an earlier run on this thread
+    pointsArray.resetIds(nbo);
+    pointsArray.placeRandomly();
+    hormone1Started = false;
+    hormone2Started = false;
+    hormoneIMEX.correction1.clear();
+    hormoneIMEX.correction2.clear();
+    leafMesh.invalidate();
+    currentTime = 0;
+    hormoneLimit = DBL_MAX;
+    stepCount = 0;
+    lastProgressLine = -1;
+    divisionScheduler.reset();
+    startDomain();
+    traceStart();   /// the trace buffer is allocated before the first step, not during it
+}
+
+#if TRACE
+/// edges too long for a spring at either end, so without any force (see springCoefficient())
+int countBrokenEdges(const EdgeList& edges){
+    std::vector<vector2D>& pos = pointsArray.disVec;
+    const double* radius = pointsArray.cellRadius.data();
+    int broken = 0;
+    for (int e = 0; e < edges.size(); e++) {
+        int i = edges.first[e], j = edges.second[e];
+        double reach = (1 + breakSpringCoeff) * std::max(radius[i], radius[j]);
+        if ((pos[j] - pos[i]).magnitude_squared() > reach * reach) {
+            broken++;
+        }
+    }
+    return broken;
+}
+#endif
+
+/// divide, find the neighbours, then move the cells and update the hormones over one timestep
+StepResult simulationStep(){
+    TRACE_SCOPE("step");
+#if TRACE
+    uint64_t allocatedBefore = traceAllocatedBytes.load();
+    int cellsBefore = nbo;
+#endif
+    if (reorderPeriod > 0 && stepCount > 0 && stepCount % reorderPeriod == 0) {
+        reorderCells();
+    }
+    calcMitosis();
+    TRACE_COUNTER("divisions", nbo - cellsBefore);
+    if (!exchangeHalo()) {
+        return STEP_FAILED;   /// a rank has no room for the cells of its neighbours
+    }
+    markStepPart(PART_MITOSIS);
+
+    if (useContactGrid) {
+        contactGrid.build(neighbourGraph, nbo);  /// neighbours of each point within spring reach
+    }
+    else {
+        create_triangles_list();
+        TRACE_COUNTER("triangles", numTriangleVertices / 3);
+    }
+    markStepPart(PART_CONTACTS);
+    if (!useContactGrid) {
+        neighbourGraph.build(triangleIndexList, numTriangleVertices, nbo); /// neighbours of each point from the triangles
+    }
+    edgeList.build(neighbourGraph);
+    TRACE_COUNTER("edges", edgeList.size());
+    TRACE_COUNTER("broken edges", countBrokenEdges(edgeList));
+    markStepPart(PART_NEIGHBOURS);
+
+#if MOVING_POINTS
+    v5CalcSprings(edgeList);
+#endif
+    if (adaptiveTimestep) {
+        timestep = chooseTimestep(hormoneLimit, finalTime - currentTime);
+    }
+    trackTime();
+    mechanicsStep(edgeList);
+    markStepPart(PART_MECHANICS);
+    chemistryStep(edgeList, hormoneLimit);
+    markStepPart(PART_CHEMISTRY);
+    TRACE_COUNTER("allocated bytes", traceAllocatedBytes.load() - allocatedBefore);
+    double globalHorm2 = sumHormone2();
+    bool domainReady = finishDomainStep(stepCount);
+
+    StepResult result = STEP_RUNNING;
+    if (!domainReady) {
+        result = STEP_FAILED;
+    }
+    else if ((currentTime > hormone2IntroTime) and isnan(globalHorm2)){
+        logMessage(LOG_ERROR, "Hormone2 is NaN at time %f\n", currentTime);
+        result = STEP_FAILED;
+    }
+    else if (currentTime >= finalTime) {
+        result = STEP_FINISHED;
+    }
+    stepCount++;
+    if (isRootRank()) {
+        logProgress(stepCount, currentTime, timestep, allCells(), result != STEP_RUNNING, verbose);
+    }
+    return result;
+}
+
+/// number of Fourier coefficients describing the final shape of numCells cells
+int numFourierCoeffs(int numCells){
+    int fourierCoeffsNum = 0.5*numCells;
+    if (numCells > 2*maxFourierCoeffs){
+        fourierCoeffsNum = maxFourierCoeffs;
+    }
+    return fourierCoeffsNum;
+}
+
+int numFourierCoeffs(){
+    return numFourierCoeffs(nbo);
+}
+
+#endif //FRAP_SIMULATION_H
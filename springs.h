@@ -10,7 +10,7 @@
 
 /// checks through the pointsConnected array to see if secondary point is present
 bool noDuplicateCheck(int indexValueToCheck, int arrayToCheck[], int max){
-    static bool unique = true;
+    static REPLICA_LOCAL bool unique = true;
 
     for (int i = 0; i <= max; i++) {  /// going up to total instead of over all the array is faster
         if (arrayToCheck[i] == indexValueToCheck) {
@@ -28,42 +28,86 @@ bool noDuplicateCheck(int indexValueToCheck, int arrayToCheck[], int max){
 
 
 
+/// spring coefficient for two points a distance apart, as seen by a point of the given radius
+/// the force on that point is (other.disVec - disVec) * coefficient
+inline double springCoefficient(double radius, double distance){
+    double deltaMagnitude = distance - radius;
+    if (deltaMagnitude > breakSpringCoeff*radius) {
+        return 0;   /// the connection is ignored
+    }
+    else if (deltaMagnitude > 0) {
+        return (deltaMagnitude/distance) * pointsArray.extendedHooks;   /// attracted, only the part outside the radius counts
+    }
+    else if ((deltaMagnitude < 0) and (deltaMagnitude > -0.95*radius)) {
+        return -pointsArray.compressedHooks;   /// just within the radius, repelled
+    }
+    else if ((deltaMagnitude < 0) and (deltaMagnitude < -0.95*radius)) {
+        return -pointsArray.innerCompressedHooks;   /// far within the radius, repelled strongly
+    }
+    return 0;
+}
+
+/// repels/attracts points to each other, visiting each edge of the triangulation once
+/// both ends see the springs of both radii, and receive equal and opposite forces
+void v4CalcSprings(const EdgeList& edges){
+    TRACE_SCOPE("springs");
+    std::vector<vector2D>& disVec = pointsArray.disVec;
+    std::vector<vector2D>& springVec = pointsArray.springVec;
+    std::vector<double>& cellRadius = pointsArray.cellRadius;
+
+    for (int i = 0; i < nbo; i++) {
+        springVec[i].setZeros(); /// set spring forces to 0
+    }
+    for (int e = 0; e < edges.size(); e++) {
+        int i = edges.first[e], j = edges.second[e];
+        vector2D delta = disVec[j] - disVec[i];
+        double magnitudeOfDistance = delta.magnitude();
+#if DEBUG
+        printf("deltaMag for %d to %d is %f \n", i, j, magnitudeOfDistance);
+#endif
+        double coefficient = springCoefficient(cellRadius[i], magnitudeOfDistance)
+                           + springCoefficient(cellRadius[j], magnitudeOfDistance);
+        springVec[i] += delta * coefficient;
+        springVec[j] -= delta * coefficient;
+    }
+}
+
+
 /// repels/attracts points to each other dependent on relative displacement
 /// currently only v3 has aliases
-void v3CalcSprings(int** neighbourhoods){
+void v3CalcSprings(const NeighbourGraph& graph){
+    TRACE_SCOPE("springs");
     for(int i = 0; i < nbo; i++) { ///for each primary point in pointsArray (iterates through each point using i)
-        Point& centre = pointsArray[i]; /// alias for pointsArray[i]
+        Point centre = pointsArray[i]; /// alias for pointsArray[i]
         pointsArray[i].springVec.setZeros(); /// set spring forces to 0
 
-        for (int l = 0; l < NAW; l++) {
-            if (neighbourhoods[i][l] != -1){
-                Point& neighbour = pointsArray[neighbourhoods[i][l]]; /// alias for pointsArray[neighbourhoods[i][l]]
-                /// find the magnitude of distance between the neighbouring point and the central point
-                double magnitudeOfDistance = (neighbour.disVec - centre.disVec).magnitude();
-                double deltaMagnitude = magnitudeOfDistance - centre.cellRadius;
+        for (int l = graph.begin(i); l < graph.end(i); l++) {
+            Point neighbour = pointsArray[graph.indices[l]]; /// alias for pointsArray[graph.indices[l]]
+            /// find the magnitude of distance between the neighbouring point and the central point
+            double magnitudeOfDistance = (neighbour.disVec - centre.disVec).magnitude();
+            double deltaMagnitude = magnitudeOfDistance - centre.cellRadius;
 #if DEBUG
-                printf("deltaMag for %d to %d is %f \n", i, (neighbourhoods[i][l]), magnitudeOfDistance);
+            printf("deltaMag for %d to %d is %f \n", i, (graph.indices[l]), magnitudeOfDistance);
 #endif
-                if ((deltaMagnitude > breakSpringCoeff*centre.cellRadius)) {
-                    /// do nothing, the connection is ignored (need to show this in graphics somehow)
-                }
-                else if ((deltaMagnitude > 0)){
-                    /// aka point exists outside of the repulsion radius of neighbour it is attracted
-                    centre.springVec += (neighbour.disVec - (centre.disVec))
-                                        * (deltaMagnitude/magnitudeOfDistance) * centre.extendedHooks;  /// deltaMag/Mag is needed to scale the x component to only that outside the radius of equilibrium
-                    neighbour.springVec -= (neighbour.disVec - (centre.disVec))
-                                           * (deltaMagnitude/magnitudeOfDistance) * centre.extendedHooks;
-                }
-                else if ((deltaMagnitude < 0) and (deltaMagnitude > -0.95*centre.cellRadius)){
-                    /// aka point exists just within the radius of the neighbouring point and is repelled
-                    centre.springVec -= ((neighbour.disVec) - (centre.disVec)) * centre.compressedHooks;
-                    neighbour.springVec += ((neighbour.disVec) - (centre.disVec)) * centre.compressedHooks;
-                }
-                else if ((deltaMagnitude < 0) and (deltaMagnitude < -0.95*centre.cellRadius)) {
-                    /// aka point exists just very far within the radius of the neighbouring point and is repelled strongly
-                    centre.springVec -= ((neighbour.disVec) - (centre.disVec)) * centre.innerCompressedHooks;
-                    neighbour.springVec += ((neighbour.disVec) - (centre.disVec)) * centre.innerCompressedHooks;
-                }
+            if ((deltaMagnitude > breakSpringCoeff*centre.cellRadius)) {
+                /// do nothing, the connection is ignored (need to show this in graphics somehow)
+            }
+            else if ((deltaMagnitude > 0)){
+                /// aka point exists outside of the repulsion radius of neighbour it is attracted
+                centre.springVec += (neighbour.disVec - (centre.disVec))
+                                    * (deltaMagnitude/magnitudeOfDistance) * centre.extendedHooks;  /// deltaMag/Mag is needed to scale the x component to only that outside the radius of equilibrium
+                neighbour.springVec -= (neighbour.disVec - (centre.disVec))
+                                       * (deltaMagnitude/magnitudeOfDistance) * centre.extendedHooks;
+            }
+            else if ((deltaMagnitude < 0) and (deltaMagnitude > -0.95*centre.cellRadius)){
+                /// aka point exists just within the radius of the neighbouring point and is repelled
+                centre.springVec -= ((neighbour.disVec) - (centre.disVec)) * centre.compressedHooks;
+                neighbour.springVec += ((neighbour.disVec) - (centre.disVec)) * centre.compressedHooks;
+            }
+            else if ((deltaMagnitude < 0) and (deltaMagnitude < -0.95*centre.cellRadius)) {
+                /// aka point exists just very far within the radius of the neighbouring point and is repelled strongly
+                centre.springVec -= ((neighbour.disVec) - (centre.disVec)) * centre.innerCompressedHooks;
+                neighbour.springVec += ((neighbour.disVec) - (centre.disVec)) * centre.innerCompressedHooks;
             }
         }
     }
@@ -71,6 +115,7 @@ void v3CalcSprings(int** neighbourhoods){
 
 
 void v2CalcSprings(){
+    TRACE_SCOPE("springs");
 
     /// number of triangle vertices seems to average at 6 per point, setting to 15 for saftey
     /// NAW = neighbourhood array width
@@ -182,6 +227,7 @@ void v2CalcSprings(){
 
 
 void v1CalcSprings(){  /// currently deprecated (needs pairwise interactions & aliases)
+    TRACE_SCOPE("springs");
     for(int i = 0; i < nbo; i++) { ///for each primary point in pointsArray (iterates through each point using i)
 
         int pointsConnected[MAX]; /// create an array for the neighbours of a primary point
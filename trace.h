@@ -0,0 +1,201 @@
+//
+// Timers and counters around the phases of a step, written as a Chrome trace (chrome://tracing, Perfetto)
+//
+
+#ifndef FRAP_TRACE_H
+#define FRAP_TRACE_H
+#include "replica.h"
+
+/// Built with TRACE true (cmake -DLEAFSIM_TRACE=ON), TRACE_SCOPE("name") times the rest of the enclosing
+/// block and TRACE_COUNTER("name", value) records a value. Without it the macros are empty and their
+/// arguments are not evaluated.
+/// The events go to a ring buffer of traceCapacity events (the oldest are overwritten), which
+/// traceWrite() saves to traceFile: a Chrome trace if the name ends in .json, otherwise in binary:
+///   "LSTRACE1", uint32 number of names, the names (each ending with 0), uint64 number of events,
+///   then per event: uint32 name index, uint32 kind ('X' timed scope, 'C' counter),
+///   uint64 start in ns, uint64 duration in ns or the bits of the double value of a counter.
+/// The scopes are only used outside the OpenMP loops, by the thread running the simulation.
+#ifndef TRACE
+#define TRACE false
+#endif
+
+#if TRACE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <new>
+#include <vector>
+
+struct TraceEvent
+{
+    const char* name;    /// a string literal
+    char kind;           /// 'X' or 'C'
+    uint64_t start;      /// ns
+    uint64_t duration;   /// ns
+    double value;
+};
+
+class TraceBuffer
+{
+public:
+    std::vector<TraceEvent> events;
+    size_t total = 0;    /// events recorded, including the overwritten ones
+
+    static uint64_t now(){
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /// allocate the ring and start the clock, once; called before the first step (traceStart()) so that
+    /// neither is part of it, and by the first scope otherwise
+    void open(){
+        if (events.empty()) {
+            events.resize(traceCapacity > 0 ? traceCapacity : 1);
+            origin = now();
+        }
+    }
+
+    void record(const char* name, char kind, uint64_t start, uint64_t duration, double value){
+        open();
+        TraceEvent& e = events[total % events.size()];
+        e.name = name;
+        e.kind = kind;
+        e.start = start - origin;
+        e.duration = duration;
+        e.value = value;
+        total++;
+    }
+
+    /// the events still in the buffer, oldest first
+    std::vector<TraceEvent> chronological() const{
+        std::vector<TraceEvent> list;
+        size_t count = std::min(total, events.size());
+        for (size_t i = total - count; i < total; i++) {
+            list.push_back(events[i % events.size()]);
+        }
+        return list;
+    }
+
+private:
+    uint64_t origin = 0;
+};
+
+REPLICA_LOCAL TraceBuffer traceBuffer;
+
+/// bytes requested from operator new by every thread, counted by the replacements below
+std::atomic<uint64_t> traceAllocatedBytes(0);
+
+/// times its own lifetime
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name) : name(name){
+        traceBuffer.open();   /// the clock must start before the outermost scope
+        start = TraceBuffer::now();
+    }
+    ~TraceScope(){
+        traceBuffer.record(name, 'X', start, TraceBuffer::now() - start, 0);
+    }
+
+private:
+    const char* name;
+    uint64_t start;
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_COUNTER(name, value) traceBuffer.record(name, 'C', TraceBuffer::now(), 0, (double)(value))
+
+void traceStart(){
+    traceBuffer.open();
+}
+
+void* operator new(size_t size){
+    traceAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    void* ptr = malloc(size ? size : 1);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept{
+    free(ptr);
+}
+
+/// save the buffer to traceFile
+void traceWrite(){
+    std::vector<TraceEvent> list = traceBuffer.chronological();
+    size_t n = strlen(traceFile.c_str());
+    bool json = (n > 5 && strcmp(traceFile.c_str() + n - 5, ".json") == 0);
+    FILE *file = fopen(traceFile.c_str(), json ? "w" : "wb");
+    if (file == NULL) {
+        logMessage(LOG_ERROR, "Error opening file `%s'!\n", traceFile.c_str());
+        return;
+    }
+    if (json) {
+        fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+        for (size_t i = 0; i < list.size(); i++) {
+            const TraceEvent& e = list[i];
+            if (e.kind == 'X') {
+                fprintf(file, "{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"ts\": %.3f, \"dur\": %.3f}",
+                        e.name, e.start * 1e-3, e.duration * 1e-3);
+            }
+            else {
+                fprintf(file, "{\"name\": \"%s\", \"ph\": \"C\", \"pid\": 1, \"tid\": 1, \"ts\": %.3f, \"args\": {\"value\": %.17g}}",
+                        e.name, e.start * 1e-3, e.value);
+            }
+            fprintf(file, "%s\n", (i + 1 < list.size()) ? "," : "");
+        }
+        fprintf(file, "]}\n");
+    }
+    else {
+        std::vector<const char*> names;
+        std::vector<uint32_t> index(list.size());
+        for (size_t i = 0; i < list.size(); i++) {
+            size_t k = 0;
+            while (k < names.size() && names[k] != list[i].name) k++;
+            if (k == names.size()) names.push_back(list[i].name);
+            index[i] = k;
+        }
+        fwrite("LSTRACE1", 1, 8, file);
+        uint32_t numNames = names.size();
+        fwrite(&numNames, sizeof(numNames), 1, file);
+        for (size_t k = 0; k < names.size(); k++) {
+            fwrite(names[k], 1, strlen(names[k]) + 1, file);
+        }
+        uint64_t numEvents = list.size();
+        fwrite(&numEvents, sizeof(numEvents), 1, file);
+        for (size_t i = 0; i < list.size(); i++) {
+            uint32_t kind = list[i].kind;
+            uint64_t payload = list[i].duration;
+            if (list[i].kind == 'C') {
+                memcpy(&payload, &list[i].value, sizeof(payload));
+            }
+            fwrite(&index[i], sizeof(uint32_t), 1, file);
+            fwrite(&kind, sizeof(kind), 1, file);
+            fwrite(&list[i].start, sizeof(uint64_t), 1, file);
+            fwrite(&payload, sizeof(payload), 1, file);
+        }
+    }
+    fclose(file);
+    logMessage(LOG_INFO, "Trace of %zu events saved to %s (%zu recorded)\n", list.size(), traceFile.c_str(), traceBuffer.total);
+}
+
+#else
+
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+
+void traceStart(){}
+void traceWrite(){}
+
+#endif //TRACE
+
+#endif //FRAP_TRACE_H
@@ -0,0 +1,564 @@
+//
+// Messages between the ranks of a simulation split over several threads or processes (see domain.h)
+//
+
+#ifndef FRAP_TRANSPORT_H
+#define FRAP_TRANSPORT_H
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+#include "replica.h"
+#include "log.h"
+#if LEAFSIM_MPI
+#include <mpi.h>
+#endif
+
+/// A Transport carries messages (blocks of bytes) between the ranks of one simulation. Each rank sees the
+/// messages of another in the order they were sent. Every rank makes the same calls in the same order,
+/// so the messages need no tags. The collective operations go through rank 0 by default, which combines
+/// the ranks in order: the result does not depend on which rank was first.
+/// The implementations:
+///   - LocalTransport: ranks are threads of one process, messages go through mailboxes in memory
+///   - SocketTransport: one rank per process, over TCP, on one machine or several
+///   - MpiTransport: one rank per process, over MPI (built with -DLEAFSIM_MPI=ON)
+
+enum ReduceOp
+{
+    REDUCE_SUM = 0,
+    REDUCE_MIN,
+    REDUCE_MAX
+};
+
+class Transport
+{
+public:
+    virtual ~Transport(){}
+
+    virtual int rank() const = 0;
+    virtual int size() const = 0;
+
+    /// a message to peer
+    virtual void send(int peer, const void* data, size_t bytes) = 0;
+
+    /// the next message from peer, waits for it
+    virtual void receive(int peer, std::vector<char>& data) = 0;
+
+    /// send to dest and receive from source (-1 for none) at once: all the ranks can call it together
+    /// without waiting on each other, whatever the size of the messages; in is empty without a source
+    virtual void sendReceive(int dest, const void* data, size_t bytes, int source, std::vector<char>& in){
+        if (dest >= 0) send(dest, data, bytes);
+        if (source >= 0) receive(source, in);
+        else in.clear();
+    }
+
+    /// values[k] becomes the sum, the minimum or the maximum of values[k] over the ranks, on every rank
+    virtual void allReduce(double* values, int count, ReduceOp op){
+        if (size() == 1) return;
+        if (rank() == 0) {
+            for (int r = 1; r < size(); r++) {
+                receive(r, buffer);
+                const double* other = (const double*)buffer.data();
+                for (int k = 0; k < count; k++) {
+                    if (op == REDUCE_SUM) values[k] += other[k];
+                    else if (op == REDUCE_MIN) values[k] = std::min(values[k], other[k]);
+                    else values[k] = std::max(values[k], other[k]);
+                }
+            }
+            for (int r = 1; r < size(); r++) {
+                send(r, values, count * sizeof(double));
+            }
+        }
+        else {
+            send(0, values, count * sizeof(double));
+            receive(0, buffer);
+            memcpy(values, buffer.data(), count * sizeof(double));
+        }
+    }
+
+    /// the value of every rank, in the order of the ranks, on every rank
+    virtual void allGather(int value, std::vector<int>& all){
+        all.assign(size(), 0);
+        all[rank()] = value;
+        if (size() == 1) return;
+        if (rank() == 0) {
+            for (int r = 1; r < size(); r++) {
+                receive(r, buffer);
+                memcpy(&all[r], buffer.data(), sizeof(int));
+            }
+            for (int r = 1; r < size(); r++) {
+                send(r, all.data(), all.size() * sizeof(int));
+            }
+        }
+        else {
+            send(0, &value, sizeof(int));
+            receive(0, buffer);
+            memcpy(all.data(), buffer.data(), all.size() * sizeof(int));
+        }
+    }
+
+    /// the message of every rank at rank 0, in the order of the ranks; parts stays empty on the others
+    virtual void gather(const void* data, size_t bytes, std::vector<std::vector<char>>& parts){
+        parts.clear();
+        if (rank() == 0) {
+            parts.resize(size());
+            parts[0].assign((const char*)data, (const char*)data + bytes);
+            for (int r = 1; r < size(); r++) {
+                receive(r, parts[r]);
+            }
+        }
+        else {
+            send(0, data, bytes);
+        }
+    }
+
+protected:
+    std::vector<char> buffer;
+};
+
+
+/// the mailboxes of ranks running as threads of one process, one per (sender, receiver)
+class LocalExchange
+{
+public:
+    explicit LocalExchange(int numRanks) : numRanks(numRanks), boxes(numRanks * numRanks), arrived(numRanks) {}
+
+    int numRanks;
+
+    void post(int from, int to, const void* data, size_t bytes){
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            boxes[from * numRanks + to].push_back(std::vector<char>((const char*)data, (const char*)data + bytes));
+        }
+        arrived[to].notify_all();
+    }
+
+    void take(int from, int to, std::vector<char>& data){
+        std::unique_lock<std::mutex> lock(mutex);
+        std::deque<std::vector<char>>& box = boxes[from * numRanks + to];
+        arrived[to].wait(lock, [&box]{ return !box.empty(); });
+        data.swap(box.front());
+        box.pop_front();
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<std::deque<std::vector<char>>> boxes;
+    std::vector<std::condition_variable> arrived;   /// per receiver
+};
+
+/// sending never waits, as the mailboxes have no limit
+class LocalTransport : public Transport
+{
+public:
+    LocalTransport(LocalExchange& exchange, int rank) : exchange(exchange), myRank(rank) {}
+
+    int rank() const{ return myRank; }
+    int size() const{ return exchange.numRanks; }
+
+    void send(int peer, const void* data, size_t bytes){
+        exchange.post(myRank, peer, data, bytes);
+    }
+
+    void receive(int peer, std::vector<char>& data){
+        exchange.take(peer, myRank, data);
+    }
+
+private:
+    LocalExchange& exchange;
+    int myRank;
+};
+
+
+/// One TCP connection per pair of ranks that talk to each other: neighbours (r, r+1) and (0, r) for the
+/// collective operations. peers[r] is "host:port" of rank r, where it listens while the ranks connect.
+/// Each message is its length (uint64) followed by its bytes. A broken connection ends the process,
+/// as the simulation cannot go on without one of its slabs.
+class SocketTransport : public Transport
+{
+public:
+    /// connect to the other ranks, waiting at most timeout seconds for them to start
+    SocketTransport(int rank, const std::vector<std::string>& peers, double timeout = 60)
+        : myRank(rank), numRanks(peers.size()), sockets(peers.size(), -1)
+    {
+        ok = connectAll(peers, timeout);
+    }
+
+    ~SocketTransport(){
+        for (size_t r = 0; r < sockets.size(); r++) {
+            if (sockets[r] >= 0) close(sockets[r]);
+        }
+    }
+
+    bool ok = false;   /// false if some rank could not be reached
+
+    int rank() const{ return myRank; }
+    int size() const{ return numRanks; }
+
+    void send(int peer, const void* data, size_t bytes){
+        uint64_t length = bytes;
+        writeAll(peer, &length, sizeof(length));
+        writeAll(peer, data, bytes);
+    }
+
+    void receive(int peer, std::vector<char>& data){
+        uint64_t length = 0;
+        readAll(peer, &length, sizeof(length));
+        data.resize(length);
+        readAll(peer, data.data(), length);
+    }
+
+    /// both directions go on together through poll(), so that two ranks sending large messages
+    /// to each other do not both wait for the other to read
+    void sendReceive(int dest, const void* data, size_t bytes, int source, std::vector<char>& in){
+        if (dest < 0 || source < 0) {
+            Transport::sendReceive(dest, data, bytes, source, in);
+            return;
+        }
+        uint64_t length = bytes, inLength = 0;
+        size_t sent = 0, received = 0;                        /// counting the length headers
+        size_t outTotal = sizeof(length) + bytes, inTotal = sizeof(inLength);
+        while (sent < outTotal || received < inTotal) {
+            struct pollfd fds[2];
+            int numFds = 0, out = -1, inp = -1;
+            if (sent < outTotal) {
+                fds[numFds] = {link(dest), POLLOUT, 0};
+                out = numFds++;
+            }
+            if (received < inTotal) {
+                if (out >= 0 && link(source) == link(dest)) {
+                    fds[out].events |= POLLIN;
+                    inp = out;
+                }
+                else {
+                    fds[numFds] = {link(source), POLLIN, 0};
+                    inp = numFds++;
+                }
+            }
+            if (poll(fds, numFds, -1) < 0) {
+                if (errno == EINTR) continue;
+                fail("poll");
+            }
+            if (out >= 0 && (fds[out].revents & (POLLOUT | POLLERR | POLLHUP))) {
+                const char* from = (sent < sizeof(length)) ? (const char*)&length + sent : (const char*)data + (sent - sizeof(length));
+                size_t chunk = (sent < sizeof(length)) ? sizeof(length) - sent : outTotal - sent;
+                ssize_t n = ::send(link(dest), from, chunk, MSG_DONTWAIT | MSG_NOSIGNAL);
+                if (n > 0) sent += n;
+                else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) fail("send");
+            }
+            if (inp >= 0 && (fds[inp].revents & (POLLIN | POLLERR | POLLHUP))) {
+                char* to = (received < sizeof(inLength)) ? (char*)&inLength + received : in.data() + (received - sizeof(inLength));
+                size_t chunk = (received < sizeof(inLength)) ? sizeof(inLength) - received : inTotal - received;
+                ssize_t n = recv(link(source), to, chunk, MSG_DONTWAIT);
+                if (n > 0) {
+                    received += n;
+                    if (received == sizeof(inLength)) {
+                        in.resize(inLength);
+                        inTotal += inLength;
+                    }
+                }
+                else if (n == 0) fail("recv");
+                else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) fail("recv");
+            }
+        }
+    }
+
+private:
+    int myRank, numRanks;
+    std::vector<int> sockets;   /// per rank, -1 if not connected
+
+    static bool linked(int a, int b){
+        return a != b && (a == 0 || b == 0 || a == b + 1 || b == a + 1);
+    }
+
+    int link(int peer){
+        if (peer < 0 || peer >= numRanks || sockets[peer] < 0) {
+            logMessage(LOG_ERROR, "Rank %d has no connection to rank %d\n", myRank, peer);
+            logFlush();
+            exit(EXIT_FAILURE);
+        }
+        return sockets[peer];
+    }
+
+    void fail(const char* call){
+        logMessage(LOG_ERROR, "Rank %d: %s failed (%s), a rank has stopped\n", myRank, call, strerror(errno ? errno : EPIPE));
+        logFlush();
+        exit(EXIT_FAILURE);
+    }
+
+    void writeAll(int peer, const void* data, size_t bytes){
+        const char* from = (const char*)data;
+        while (bytes > 0) {
+            ssize_t n = ::send(link(peer), from, bytes, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) fail("send");
+            from += n;
+            bytes -= n;
+        }
+    }
+
+    void readAll(int peer, void* data, size_t bytes){
+        char* to = (char*)data;
+        while (bytes > 0) {
+            ssize_t n = recv(link(peer), to, bytes, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) fail("recv");
+            to += n;
+            bytes -= n;
+        }
+    }
+
+    static bool splitAddress(const std::string& address, std::string& host, std::string& port){
+        size_t colon = address.rfind(':');
+        if (colon == std::string::npos) return false;
+        host = address.substr(0, colon);
+        port = address.substr(colon + 1);
+        return !port.empty();
+    }
+
+    /// listen on the own port, connect to the lower ranks, then accept the higher ones, which say who they are
+    bool connectAll(const std::vector<std::string>& peers, double timeout){
+        std::string host, port;
+        if (!splitAddress(peers[myRank], host, port)) {
+            logMessage(LOG_ERROR, "Rank %d: `%s' is not host:port\n", myRank, peers[myRank].c_str());
+            return false;
+        }
+        int listener = socket(AF_INET, SOCK_STREAM, 0);
+        int yes = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(atoi(port.c_str()));
+        if (bind(listener, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listener, numRanks) < 0) {
+            logMessage(LOG_ERROR, "Rank %d cannot listen on port %s (%s)\n", myRank, port.c_str(), strerror(errno));
+            close(listener);
+            return false;
+        }
+
+        bool connected = true;
+        for (int peer = 0; peer < myRank && connected; peer++) {
+            if (!linked(myRank, peer)) continue;
+            if (!splitAddress(peers[peer], host, port)) {
+                logMessage(LOG_ERROR, "Rank %d: `%s' is not host:port\n", myRank, peers[peer].c_str());
+                connected = false;
+                break;
+            }
+            sockets[peer] = connectTo(host, port, timeout);
+            if (sockets[peer] < 0) {
+                logMessage(LOG_ERROR, "Rank %d cannot connect to rank %d at %s\n", myRank, peer, peers[peer].c_str());
+                connected = false;
+                break;
+            }
+            int32_t me = myRank;
+            writeAll(peer, &me, sizeof(me));
+        }
+
+        int expected = 0;
+        for (int peer = myRank + 1; peer < numRanks; peer++) {
+            expected += linked(myRank, peer);
+        }
+        for (int a = 0; a < expected && connected; a++) {
+            int fd = accept(listener, NULL, NULL);
+            int32_t peer = -1;
+            if (fd < 0 || recv(fd, &peer, sizeof(peer), MSG_WAITALL) != sizeof(peer) || peer <= myRank || peer >= numRanks) {
+                logMessage(LOG_ERROR, "Rank %d: bad connection from another rank\n", myRank);
+                if (fd >= 0) close(fd);
+                connected = false;
+                break;
+            }
+            sockets[peer] = fd;
+        }
+        close(listener);
+
+        for (int peer = 0; peer < numRanks; peer++) {
+            if (sockets[peer] >= 0) {
+                setsockopt(sockets[peer], IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+            }
+        }
+        return connected;
+    }
+
+    /// retried until the rank listens, for at most timeout seconds
+    static int connectTo(const std::string& host, const std::string& port, double timeout){
+        struct addrinfo hints, *found = NULL;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0 || !found) {
+            return -1;
+        }
+        auto start = std::chrono::steady_clock::now();
+        int fd = -1;
+        while (true) {
+            fd = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+            if (connect(fd, found->ai_addr, found->ai_addrlen) == 0) break;
+            close(fd);
+            fd = -1;
+            if (std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() > timeout) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        freeaddrinfo(found);
+        return fd;
+    }
+};
+
+
+#if LEAFSIM_MPI
+/// over MPI_COMM_WORLD, MPI_Init() must have been called; the reductions are MPI's own
+class MpiTransport : public Transport
+{
+public:
+    MpiTransport(){
+        MPI_Comm_rank(MPI_COMM_WORLD, &myRank);
+        MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+    }
+
+    int rank() const{ return myRank; }
+    int size() const{ return numRanks; }
+
+    void send(int peer, const void* data, size_t bytes){
+        MPI_Send(data, (int)bytes, MPI_BYTE, peer, 0, MPI_COMM_WORLD);
+    }
+
+    void receive(int peer, std::vector<char>& data){
+        MPI_Status status;
+        int count = 0;
+        MPI_Probe(peer, 0, MPI_COMM_WORLD, &status);
+        MPI_Get_count(&status, MPI_BYTE, &count);
+        data.resize(count);
+        MPI_Recv(data.data(), count, MPI_BYTE, peer, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    }
+
+    /// the sizes first, then the messages
+    void sendReceive(int dest, const void* data, size_t bytes, int source, std::vector<char>& in){
+        int to = (dest < 0) ? MPI_PROC_NULL : dest;
+        int from = (source < 0) ? MPI_PROC_NULL : source;
+        uint64_t length = bytes, inLength = 0;
+        MPI_Sendrecv(&length, 1, MPI_UINT64_T, to, 1, &inLength, 1, MPI_UINT64_T, from, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        in.resize(inLength);
+        MPI_Sendrecv(data, (int)bytes, MPI_BYTE, to, 0, in.data(), (int)inLength, MPI_BYTE, from, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    }
+
+    void allReduce(double* values, int count, ReduceOp op){
+        MPI_Op mpiOp = (op == REDUCE_SUM) ? MPI_SUM : (op == REDUCE_MIN) ? MPI_MIN : MPI_MAX;
+        MPI_Allreduce(MPI_IN_PLACE, values, count, MPI_DOUBLE, mpiOp, MPI_COMM_WORLD);
+    }
+
+    void allGather(int value, std::vector<int>& all){
+        all.resize(numRanks);
+        MPI_Allgather(&value, 1, MPI_INT, all.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    }
+
+private:
+    int myRank = 0, numRanks = 1;
+};
+#endif
+
+
+REPLICA_LOCAL Transport* transport = NULL;   /// set by leafsim_domain, NULL for a simulation in one piece
+
+/// rank 0 writes the progress and the results
+bool isRootRank(){
+    return !transport || transport->rank() == 0;
+}
+
+double globalSum(double value){
+    if (transport) transport->allReduce(&value, 1, REDUCE_SUM);
+    return value;
+}
+
+double globalMax(double value){
+    if (transport) transport->allReduce(&value, 1, REDUCE_MAX);
+    return value;
+}
+
+double globalMin(double value){
+    if (transport) transport->allReduce(&value, 1, REDUCE_MIN);
+    return value;
+}
+
+/// true on the rank holding the smallest value, the lowest such rank in case of a tie
+bool globalArgMin(double value){
+    if (!transport) return true;
+    double smallest = globalMin(value);
+    double holder = globalMin((value == smallest) ? transport->rank() : transport->size());
+    return holder == transport->rank();
+}
+
+
+/// The cells of the two neighbouring ranks that a rank needs during a step (filled by exchangeHalo(), domain.h):
+/// they are copied after the own cells of the rank in pointsArray, those of the rank on the left
+/// (rank - 1) then those of the rank on the right. The copies are brought up to date with refresh().
+class Halo
+{
+public:
+    std::vector<int> sendLeft, sendRight;   /// own cells copied to the rank on the left / right
+    int leftStart = 0, leftCount = 0;       /// where the copies of the cells of the left rank are
+    int rightStart = 0, rightCount = 0;
+    int numCopies = 0;                      /// leftCount + rightCount while the copies are there, 0 otherwise
+
+    /// values[] of the copies from the values of their own rank
+    template <typename T>
+    void refresh(T* values){
+        int left = transport->rank() - 1;
+        int right = (transport->rank() + 1 < transport->size()) ? transport->rank() + 1 : -1;
+        pack(values, sendRight);
+        transport->sendReceive(right, out.data(), out.size(), left, in);
+        unpack(values, leftStart, leftCount);
+        pack(values, sendLeft);
+        transport->sendReceive(left, out.data(), out.size(), right, in);
+        unpack(values, rightStart, rightCount);
+    }
+
+private:
+    std::vector<char> out, in;
+
+    template <typename T>
+    void pack(const T* values, const std::vector<int>& cells){
+        out.resize(cells.size() * sizeof(T));
+        T* to = (T*)out.data();
+        for (size_t k = 0; k < cells.size(); k++) {
+            to[k] = values[cells[k]];
+        }
+    }
+
+    template <typename T>
+    void unpack(T* values, int start, int count){
+        if (count > 0) {
+            memcpy((void*)(values + start), in.data(), count * sizeof(T));
+        }
+    }
+};
+
+REPLICA_LOCAL Halo halo;
+
+/// the cells this rank updates, the first ones of pointsArray, without the copies of the halo
+int ownedCells(){
+    return nbo - halo.numCopies;
+}
+
+/// bring the copies of values[] (indexed by cell) up to date, nothing to do for a simulation in one piece
+template <typename T>
+void refreshHalo(T* values){
+    if (transport && transport->size() > 1) {
+        halo.refresh(values);
+    }
+}
+
+#endif //FRAP_TRANSPORT_H